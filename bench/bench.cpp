@@ -0,0 +1,730 @@
+// Benchmarks for every stage of the pipeline. Writes one JSON document with
+// throughput and latency percentiles per stage plus an end-to-end scaling
+// curve, so runs from different versions can be compared.
+//
+// Usage: bohemia_bench [output.json] [--quick]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <complex>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "XoshiroCpp.h"
+#include "json.h"
+
+#include "eigen_solver.h"
+#include "eigenvalue.h"
+#include "eigenvalue_reader.h"
+#include "eigenvalue_writer.h"
+#include "image.h"
+#include "logger.h"
+#include "matrix.h"
+#include "matrix_generator.h"
+#include "reduced_sampler.h"
+#include "scheduler.h"
+#include "spectrum_memo.h"
+#include "static_matrix_generator.h"
+#include "util.h"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Scales every workload; --quick divides it by 10.
+double work_scale = 1.0;
+// Keeps results of otherwise unused reads alive.
+volatile double sink = 0;
+
+uint64_t scaled(uint64_t count) {
+    return std::max<uint64_t>(1, static_cast<uint64_t>(count * work_scale));
+}
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Times `op` in `rounds` rounds of `ops_per_round` calls. Latencies are the
+// per-call average of each round, so cheap operations are not dominated by
+// clock overhead.
+json measure(const std::string& name, json params, uint64_t rounds, uint64_t ops_per_round,
+             const std::function<void()>& op) {
+    std::vector<double> latencies;
+    latencies.reserve(rounds);
+    const auto start = Clock::now();
+    for (uint64_t round = 0; round < rounds; ++round) {
+        const auto round_start = Clock::now();
+        for (uint64_t i = 0; i < ops_per_round; ++i) {
+            op();
+        }
+        latencies.push_back(seconds_since(round_start) * 1e9 / ops_per_round);
+    }
+    const double elapsed = seconds_since(start);
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    };
+
+    const uint64_t ops = rounds * ops_per_round;
+    json result = {
+        {"name", name},
+        {"params", std::move(params)},
+        {"ops", ops},
+        {"seconds", elapsed},
+        {"ops_per_second", ops / elapsed},
+        {"latency_ns", {{"p50", percentile(0.5)}, {"p90", percentile(0.9)},
+                        {"p99", percentile(0.99)}, {"max", latencies.back()}}}
+    };
+    LOG_INFO << name << " " << result["params"].dump() << ": " << result["ops_per_second"].get<double>() << " ops/s";
+    return result;
+}
+
+// Same as measure() for an operation run by `threads` threads at once. The
+// threads are started before the clock and released together, and each runs
+// `rounds` passes over [0, ops_per_thread) through op(thread, begin, end) in
+// batches of LATENCY_BATCH operations. Every batch is timed, so the latency
+// percentiles are over per-operation averages of all batches of all threads;
+// throughput is from the release to the last thread's end.
+constexpr uint64_t LATENCY_BATCH = 1024;
+
+json measure_parallel(const std::string& name, json params, int threads, uint64_t rounds, uint64_t ops_per_thread,
+                      const std::function<void(int thread, uint64_t begin, uint64_t end)>& op) {
+    params["threads"] = threads;
+    const uint64_t batches_per_round = (ops_per_thread + LATENCY_BATCH - 1) / LATENCY_BATCH;
+    std::vector<std::vector<double>> latencies(threads);
+    std::vector<Clock::time_point> finished(threads);
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        latencies[t].reserve(rounds * batches_per_round);
+        workers.emplace_back([&, t] {
+            ready++;
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            for (uint64_t round = 0; round < rounds; ++round) {
+                for (uint64_t begin = 0; begin < ops_per_thread; begin += LATENCY_BATCH) {
+                    const uint64_t end = std::min(begin + LATENCY_BATCH, ops_per_thread);
+                    const auto batch_start = Clock::now();
+                    op(t, begin, end);
+                    latencies[t].push_back(seconds_since(batch_start) * 1e9 / (end - begin));
+                }
+            }
+            finished[t] = Clock::now();
+        });
+    }
+    while (ready.load() < threads) {
+        std::this_thread::yield();
+    }
+    const auto start = Clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    const double elapsed = std::chrono::duration<double>(*std::max_element(finished.begin(), finished.end()) - start).count();
+
+    std::vector<double> all;
+    for (const auto& thread_latencies : latencies) {
+        all.insert(all.end(), thread_latencies.begin(), thread_latencies.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) {
+        return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))];
+    };
+
+    const uint64_t ops = rounds * ops_per_thread * threads;
+    json result = {
+        {"name", name},
+        {"params", std::move(params)},
+        {"ops", ops},
+        {"seconds", elapsed},
+        {"ops_per_second", ops / elapsed},
+        {"latency_batch", LATENCY_BATCH},
+        {"latency_ns", {{"p50", percentile(0.5)}, {"p90", percentile(0.9)},
+                        {"p99", percentile(0.99)}, {"max", all.back()}}}
+    };
+    LOG_INFO << name << " " << result["params"].dump() << ": " << result["ops_per_second"].get<double>() << " ops/s";
+    return result;
+}
+
+// 1, 2, 4, ... up to the core count, always including the core count.
+std::vector<int> thread_counts() {
+    const int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> counts;
+    for (int t = 1; t < cores; t *= 2) {
+        counts.push_back(t);
+    }
+    counts.push_back(cores);
+    return counts;
+}
+
+// Eigenvalue-like points spread over the default viewport.
+std::vector<std::complex<double>> random_points(size_t count) {
+    XoshiroCpp::Xoshiro256PlusPlus rng(1);
+    std::vector<std::complex<double>> points(count);
+    for (auto& point : points) {
+        point = {XoshiroCpp::DoubleFromBits(rng()) * 6 - 3, XoshiroCpp::DoubleFromBits(rng()) * 6 - 3};
+    }
+    return points;
+}
+
+std::vector<std::complex<double>> bohemian_matrix(int n, MatrixStructure structure, XoshiroCpp::Xoshiro256PlusPlus& rng) {
+    std::vector<std::complex<double>> values(storage_size(structure, n));
+    for (auto& value : values) {
+        value = BohemianValues::values[rng() % BohemianValues::values.size()];
+    }
+    return values;
+}
+
+json bench_generators() {
+    json results = json::array();
+    auto generator = MatrixGenerator::tridiagonal<10>();
+    results.push_back(measure("MatrixGenerator::generate", {{"n", 10}, {"structure", "tridiagonal"}},
+                              100, scaled(2000), [&] { generator.generate(); }));
+
+    StaticMatrixGenerator<10, TridiagonalPattern> static_generator(1);
+    std::vector<std::complex<double>> storage(static_generator.stride);
+    results.push_back(measure("StaticMatrixGenerator::generate_into", {{"n", 10}, {"structure", "tridiagonal"}},
+                              100, scaled(20000), [&] { static_generator.generate_into(storage.data()); }));
+    return results;
+}
+
+json bench_eigensolvers() {
+    json results = json::array();
+    XoshiroCpp::Xoshiro256PlusPlus rng(2);
+    for (int n : {4, 8, 10, 16, 32, 64}) {
+        for (auto structure : {MatrixStructure::Dense, MatrixStructure::Tridiagonal}) {
+            const char* structure_name = structure == MatrixStructure::Dense ? "dense" : "tridiagonal";
+            const uint64_t per_round = scaled(std::max(1, 20000 / (n * n)));
+
+            // compute_eigenvalues() works in place, so every call gets a fresh copy.
+            const Matrix matrix(n, bohemian_matrix(n, structure, rng), structure);
+            results.push_back(measure("Matrix::compute_eigenvalues", {{"n", n}, {"structure", structure_name}},
+                                      50, per_round, [&] { Matrix(matrix).compute_eigenvalues(); }));
+
+            // The batched path the sampler uses, reported per matrix.
+            EigenSolver solver(n, structure);
+            const int batch = EigenSolver::DEFAULT_BATCH_SIZE;
+            std::vector<std::complex<double>> matrices;
+            for (int i = 0; i < batch; ++i) {
+                auto values = bohemian_matrix(n, structure, rng);
+                matrices.insert(matrices.end(), values.begin(), values.end());
+            }
+            std::vector<std::complex<double>> work(matrices.size()), eigenvalues(batch * n);
+            json result = measure("EigenSolver::solve_batch", {{"n", n}, {"structure", structure_name}, {"batch", batch}},
+                                  50, std::max<uint64_t>(1, per_round / batch), [&] {
+                std::copy(matrices.begin(), matrices.end(), work.begin());
+                solver.solve_batch(work.data(), batch, eigenvalues.data());
+            });
+            result["matrices_per_second"] = result["ops_per_second"].get<double>() * batch;
+            results.push_back(result);
+
+            // Largest distance from an eigenvalue to the nearest reference one;
+            // the fast paths may order them differently.
+            auto max_error = [&](const std::vector<std::complex<double>>& candidate,
+                                 const std::vector<std::complex<double>>& reference) {
+                double error = 0;
+                for (int i = 0; i < batch; ++i) {
+                    for (int k = 0; k < n; ++k) {
+                        double nearest = std::numeric_limits<double>::max();
+                        for (int j = 0; j < n; ++j) {
+                            nearest = std::min(nearest, std::abs(candidate[i * n + k] - reference[i * n + j]));
+                        }
+                        error = std::max(error, nearest);
+                    }
+                }
+                return error;
+            };
+
+            // Mixed precision on the same batch.
+            const double tolerance = 1e-3;
+            EigenSolver mixed(n, structure);
+            mixed.use_mixed_precision(tolerance);
+            std::vector<std::complex<double>> mixed_eigenvalues(batch * n);
+            json mixed_result = measure("EigenSolver::solve_batch", {{"n", n}, {"structure", structure_name}, {"batch", batch},
+                                                                     {"precision", "mixed"}, {"tolerance", tolerance}},
+                                        50, std::max<uint64_t>(1, per_round / batch), [&] {
+                std::copy(matrices.begin(), matrices.end(), work.begin());
+                mixed.solve_batch(work.data(), batch, mixed_eigenvalues.data());
+            });
+            mixed_result["matrices_per_second"] = mixed_result["ops_per_second"].get<double>() * batch;
+            mixed_result["speedup"] = mixed_result["matrices_per_second"].get<double>() / result["matrices_per_second"].get<double>();
+            mixed_result["max_error"] = max_error(mixed_eigenvalues, eigenvalues);
+            mixed_result["fallback_rate"] = static_cast<double>(mixed.double_fallbacks()) /
+                                            (mixed_result["ops"].get<uint64_t>() * batch);
+            results.push_back(mixed_result);
+
+            // The Aberth root finder, checked against zgeev on the same batch.
+            if (structure == MatrixStructure::Tridiagonal) {
+                EigenSolver aberth(n, structure);
+                aberth.use_aberth();
+                std::vector<std::complex<double>> aberth_eigenvalues(batch * n);
+                json aberth_result = measure("EigenSolver::solve_batch", {{"n", n}, {"structure", structure_name}, {"batch", batch},
+                                                                          {"engine", "aberth"}},
+                                             50, std::max<uint64_t>(1, per_round / batch), [&] {
+                    std::copy(matrices.begin(), matrices.end(), work.begin());
+                    aberth.solve_batch(work.data(), batch, aberth_eigenvalues.data());
+                });
+
+                EigenSolver dense(n, MatrixStructure::Dense);
+                std::vector<std::complex<double>> dense_matrix(n * n), reference(batch * n);
+                for (int i = 0; i < batch; ++i) {
+                    const Matrix banded(n, std::vector<std::complex<double>>(matrices.begin() + i * solver.matrix_stride(),
+                                                                            matrices.begin() + (i + 1) * solver.matrix_stride()),
+                                        structure);
+                    for (int row = 0; row < n; ++row) {
+                        for (int column = 0; column < n; ++column) {
+                            dense_matrix[row * n + column] = banded.get(row, column);
+                        }
+                    }
+                    dense.solve(dense_matrix.data(), reference.data() + i * n);
+                }
+                aberth_result["matrices_per_second"] = aberth_result["ops_per_second"].get<double>() * batch;
+                aberth_result["speedup"] = aberth_result["matrices_per_second"].get<double>() / result["matrices_per_second"].get<double>();
+                aberth_result["max_error_vs_zgeev"] = max_error(aberth_eigenvalues, reference);
+                aberth_result["fallback_rate"] = static_cast<double>(aberth.double_fallbacks()) /
+                                                 (aberth_result["ops"].get<uint64_t>() * batch);
+                results.push_back(aberth_result);
+            }
+        }
+    }
+    return results;
+}
+
+// Every structured family through its own solver path, against zgeev on the
+// dense expansion of the same batch.
+json bench_families() {
+    json results = json::array();
+    XoshiroCpp::Xoshiro256PlusPlus rng(3);
+    const int batch = EigenSolver::DEFAULT_BATCH_SIZE;
+    for (int n : {10, 32}) {
+        for (auto structure : {MatrixStructure::UpperHessenberg, MatrixStructure::Toeplitz,
+                               MatrixStructure::Companion, MatrixStructure::Hermitian}) {
+            const uint64_t rounds = std::max<uint64_t>(1, scaled(std::max(1, 20000 / (n * n))) / batch);
+            const int stride = storage_size(structure, n);
+            std::vector<std::complex<double>> matrices, dense_matrices;
+            for (int i = 0; i < batch; ++i) {
+                const auto values = bohemian_matrix(n, structure, rng);
+                matrices.insert(matrices.end(), values.begin(), values.end());
+                const Matrix matrix(n, values, structure);
+                for (int row = 0; row < n; ++row) {
+                    for (int column = 0; column < n; ++column) {
+                        dense_matrices.push_back(matrix.get(row, column));
+                    }
+                }
+            }
+
+            EigenSolver dense(n, MatrixStructure::Dense);
+            std::vector<std::complex<double>> dense_work(dense_matrices.size()), reference(batch * n);
+            json dense_result = measure("EigenSolver::solve_batch", {{"n", n}, {"family", structure_name(structure)},
+                                                                     {"batch", batch}, {"engine", "zgeev"}},
+                                        50, rounds, [&] {
+                std::copy(dense_matrices.begin(), dense_matrices.end(), dense_work.begin());
+                dense.solve_batch(dense_work.data(), batch, reference.data());
+            });
+            dense_result["matrices_per_second"] = dense_result["ops_per_second"].get<double>() * batch;
+            results.push_back(dense_result);
+
+            // Largest distance from an eigenvalue to the nearest reference one.
+            auto max_error = [&](const std::vector<std::complex<double>>& candidate) {
+                double error = 0;
+                for (int i = 0; i < batch; ++i) {
+                    for (int k = 0; k < n; ++k) {
+                        double nearest = std::numeric_limits<double>::max();
+                        for (int j = 0; j < n; ++j) {
+                            nearest = std::min(nearest, std::abs(candidate[i * n + k] - reference[i * n + j]));
+                        }
+                        error = std::max(error, nearest);
+                    }
+                }
+                return error;
+            };
+
+            for (bool aberth : {false, true}) {
+                if (aberth && structure != MatrixStructure::Companion) {
+                    continue;
+                }
+                EigenSolver solver(n, structure);
+                if (aberth) {
+                    solver.use_aberth();
+                }
+                std::vector<std::complex<double>> work(batch * stride), eigenvalues(batch * n);
+                json result = measure("EigenSolver::solve_batch", {{"n", n}, {"family", structure_name(structure)},
+                                                                   {"batch", batch}, {"engine", aberth ? "aberth" : "lapack"}},
+                                      50, rounds, [&] {
+                    std::copy(matrices.begin(), matrices.end(), work.begin());
+                    solver.solve_batch(work.data(), batch, eigenvalues.data());
+                });
+                result["matrices_per_second"] = result["ops_per_second"].get<double>() * batch;
+                result["speedup_vs_zgeev"] = result["matrices_per_second"].get<double>() / dense_result["matrices_per_second"].get<double>();
+                result["max_error_vs_zgeev"] = max_error(eigenvalues);
+                result["fallback_rate"] = static_cast<double>(solver.double_fallbacks()) / (result["ops"].get<uint64_t>() * batch);
+                results.push_back(result);
+            }
+        }
+    }
+    return results;
+}
+
+// Matrices over the real value set, solved by the complex drivers and by the
+// real ones.
+json bench_real_arithmetic() {
+    json results = json::array();
+    XoshiroCpp::Xoshiro256PlusPlus rng(4);
+    const int batch = EigenSolver::DEFAULT_BATCH_SIZE;
+    for (int n : {10, 32}) {
+        for (auto structure : {MatrixStructure::Dense, MatrixStructure::Tridiagonal, MatrixStructure::UpperHessenberg,
+                               MatrixStructure::Toeplitz, MatrixStructure::Companion, MatrixStructure::Hermitian}) {
+            const uint64_t rounds = std::max<uint64_t>(1, scaled(std::max(1, 20000 / (n * n))) / batch);
+            const int stride = storage_size(structure, n);
+            std::vector<double> matrices(batch * stride);
+            for (auto& value : matrices) {
+                value = RealBohemianValues::values[rng() % RealBohemianValues::values.size()].real();
+            }
+            const std::vector<std::complex<double>> complex_matrices(matrices.begin(), matrices.end());
+
+            EigenSolver solver(n, structure);
+            std::vector<std::complex<double>> complex_work(complex_matrices.size()), reference(batch * n);
+            json complex_result = measure("EigenSolver::solve_batch", {{"n", n}, {"structure", structure_name(structure)},
+                                                                       {"batch", batch}, {"arithmetic", "complex"}},
+                                          50, rounds, [&] {
+                std::copy(complex_matrices.begin(), complex_matrices.end(), complex_work.begin());
+                solver.solve_batch(complex_work.data(), batch, reference.data());
+            });
+            complex_result["matrices_per_second"] = complex_result["ops_per_second"].get<double>() * batch;
+            results.push_back(complex_result);
+
+            std::vector<double> work(matrices.size());
+            std::vector<std::complex<double>> eigenvalues(batch * n);
+            json real_result = measure("EigenSolver::solve_batch", {{"n", n}, {"structure", structure_name(structure)},
+                                                                    {"batch", batch}, {"arithmetic", "real"}},
+                                       50, rounds, [&] {
+                std::copy(matrices.begin(), matrices.end(), work.begin());
+                solver.solve_batch(work.data(), batch, eigenvalues.data());
+            });
+            real_result["matrices_per_second"] = real_result["ops_per_second"].get<double>() * batch;
+            real_result["speedup"] = real_result["matrices_per_second"].get<double>() / complex_result["matrices_per_second"].get<double>();
+
+            // Largest distance from an eigenvalue to the nearest complex one.
+            double error = 0;
+            for (int i = 0; i < batch; ++i) {
+                for (int k = 0; k < n; ++k) {
+                    double nearest = std::numeric_limits<double>::max();
+                    for (int j = 0; j < n; ++j) {
+                        nearest = std::min(nearest, std::abs(eigenvalues[i * n + k] - reference[i * n + j]));
+                    }
+                    error = std::max(error, nearest);
+                }
+            }
+            real_result["max_error_vs_complex"] = error;
+            results.push_back(real_result);
+        }
+    }
+    return results;
+}
+
+// The same reduced samples solved whole by one EigenSolver, and block by block
+// through a SpectrumMemo with and without its cache. The memo starts cold, as
+// in a run.
+template<int N>
+json bench_reduced_sampling(uint64_t samples) {
+    json results = json::array();
+    ReducedTridiagonalSampler<N> sampler(3);
+    std::vector<typename ReducedTridiagonalSampler<N>::Sample> drawn(samples);
+    for (auto& sample : drawn) {
+        sampler.draw(sample);
+    }
+    std::vector<std::complex<double>> matrix(3 * N - 2), eigenvalues(N);
+    const uint64_t rounds = 10;
+    const uint64_t per_round = std::max<uint64_t>(1, samples / rounds);
+
+    EigenSolver solver(N, MatrixStructure::Tridiagonal);
+    uint64_t next = 0;
+    json whole = measure("EigenSolver::solve", {{"n", N}, {"sampler", "reduced"}}, rounds, per_round, [&] {
+        sampler.fill(drawn[next++ % samples], matrix.data());
+        solver.solve(matrix.data(), eigenvalues.data());
+    });
+    results.push_back(whole);
+
+    for (size_t capacity : {size_t(0), size_t(1) << 16}) {
+        SpectrumMemo memo(N, sampler.diagonal_values(), sampler.product_values(), capacity);
+        next = 0;
+        json result = measure("SpectrumMemo::solve", {{"n", N}, {"memo_entries", capacity}}, rounds, per_round, [&] {
+            const auto& sample = drawn[next++ % samples];
+            memo.solve(sample.diagonal.data(), sample.product.data(), eigenvalues.data());
+        });
+        result["speedup"] = result["ops_per_second"].get<double>() / whole["ops_per_second"].get<double>();
+        result["block_lookups_per_sample"] = static_cast<double>(memo.lookups()) / result["ops"].get<uint64_t>();
+        result["hit_rate"] = memo.lookups() > 0 ? static_cast<double>(memo.hits()) / memo.lookups() : 0.0;
+        results.push_back(result);
+    }
+    return results;
+}
+
+json bench_reduced_sampling() {
+    json results = json::array();
+    for (const json& part : {bench_reduced_sampling<4>(scaled(100000)), bench_reduced_sampling<6>(scaled(50000)),
+                             bench_reduced_sampling<8>(scaled(50000)), bench_reduced_sampling<10>(scaled(50000))}) {
+        results.insert(results.end(), part.begin(), part.end());
+    }
+    return results;
+}
+
+json bench_binning() {
+    json results = json::array();
+    const auto points = random_points(1 << 20);
+    const uint64_t per_thread = scaled(1 << 20);
+    for (int threads : thread_counts()) {
+        ImageHistogram histogram(2000, -3, 3, -3, 3);
+        results.push_back(measure_parallel("ImageHistogram::add_point", {{"resolution", 2000}}, threads, 5, per_thread,
+                                           [&](int thread, uint64_t begin, uint64_t end) {
+            for (uint64_t i = begin; i < end; ++i) {
+                histogram.add_point(points[(i * 7919 + thread) & (points.size() - 1)]);
+            }
+        }));
+
+        std::vector<LocalHistogram> locals;
+        for (int t = 0; t < threads; ++t) {
+            locals.emplace_back(histogram);
+        }
+        results.push_back(measure_parallel("LocalHistogram::add_point", {{"resolution", 2000}}, threads, 5, per_thread,
+                                           [&](int thread, uint64_t begin, uint64_t end) {
+            for (uint64_t i = begin; i < end; ++i) {
+                locals[thread].add_point(points[(i * 7919 + thread) & (points.size() - 1)]);
+            }
+        }));
+        histogram.merge(locals);
+    }
+    return results;
+}
+
+// Eigenvalues of sampled tridiagonal matrices, whose symmetric spectra are
+// what the PMF sees in practice.
+std::vector<std::complex<double>> tridiagonal_spectra(size_t count) {
+    StaticMatrixGenerator<10, TridiagonalPattern> generator(1);
+    EigenSolver solver(10, MatrixStructure::Tridiagonal);
+    const int batch_size = EigenSolver::DEFAULT_BATCH_SIZE;
+    std::vector<std::complex<double>> matrices(batch_size * solver.matrix_stride());
+    std::vector<std::complex<double>> eigenvalues(count + batch_size * 10);
+    for (size_t k = 0; k < count; k += batch_size * 10) {
+        generator.generate_batch(matrices.data(), batch_size);
+        solver.solve_batch(matrices.data(), batch_size, eigenvalues.data() + k);
+    }
+    eigenvalues.resize(count);
+    return eigenvalues;
+}
+
+json bench_pmf() {
+    json results = json::array();
+    const auto points = tridiagonal_spectra(1 << 20);
+    const int threads = std::max(1u, std::thread::hardware_concurrency());
+    const uint64_t per_thread = scaled(1 << 20);
+    Scheduler scheduler(threads);
+    for (int precision : {2, 3}) {
+        auto pmf = EigenvaluePMF::with_precision(precision);
+        uint64_t i = 0;
+        results.push_back(measure("EigenvaluePMF::insert", {{"precision", precision}}, 50, scaled(20000), [&] {
+            pmf.insert(points[i++ & (points.size() - 1)]);
+        }));
+        results.back()["bins"] = pmf.bin_count();
+
+        std::vector<LocalPMF> locals;
+        for (int t = 0; t < threads; ++t) {
+            locals.emplace_back(pmf);
+        }
+        results.push_back(measure_parallel("LocalPMF::insert", {{"precision", precision}}, threads, 5, per_thread,
+                                           [&](int thread, uint64_t begin, uint64_t end) {
+            for (uint64_t k = begin; k < end; ++k) {
+                locals[thread].insert(points[(k * 7919 + thread) & (points.size() - 1)]);
+            }
+        }));
+        results.push_back(measure("EigenvaluePMF::merge", {{"precision", precision}, {"threads", threads}}, 1, 1, [&] {
+            pmf.merge(locals, scheduler);
+        }));
+        results.back()["bins"] = pmf.bin_count();
+    }
+    return results;
+}
+
+json bench_render(const std::string& scratch) {
+    json results = json::array();
+    ImageHistogram histogram(2000, -3, 3, -3, 3);
+    const auto points = random_points(scaled(4 << 20));
+    for (const auto& point : points) {
+        histogram.add_point(point);
+    }
+    results.push_back(measure("ImageHistogram::save_from_histogram", {{"resolution", 2000}}, 5, 1, [&] {
+        histogram.save_from_histogram(scratch + ".png", 1.5, "viridis");
+    }));
+
+    // Re-rendering a stored run: project every PMF bin, then color.
+    auto pmf = EigenvaluePMF::with_precision(4);
+    for (const auto& point : points) {
+        pmf.insert(point);
+    }
+    results.push_back(measure("ImageHistogram::save_image", {{"resolution", 2000}, {"bins", pmf.bin_count()}}, 5, 1, [&] {
+        ImageHistogram view(2000, -3, 3, -3, 3);
+        view.save_image(scratch + ".png", 1.5, "viridis", pmf);
+    }));
+    std::remove(("output/" + scratch + ".png").c_str());
+    return results;
+}
+
+json bench_io(const std::string& scratch) {
+    json results = json::array();
+    const auto points = random_points(1 << 20);
+    const uint64_t count = scaled(16 << 20);
+    const double megabytes = count * sizeof(std::complex<double>) / 1e6;
+
+    // Raw dump through the streaming writer, then a mapped read.
+    const std::string raw_file = scratch + ".raw";
+    json write = measure("EigenvalueWriter", {{"eigenvalues", count}}, 3, 1, [&] {
+        EigenvalueWriter writer(raw_file, 8);
+        EigenvalueWriter::Chunk* chunk = writer.acquire();
+        for (uint64_t i = 0; i < count; ++i) {
+            chunk->push_back(points[i & (points.size() - 1)]);
+            if (chunk->size() == writer.chunk_size()) {
+                writer.submit(chunk);
+                chunk = writer.acquire();
+            }
+        }
+        writer.submit(chunk);
+        writer.finish();
+    });
+    write["megabytes_per_second"] = megabytes * 3 / write["seconds"].get<double>();
+    results.push_back(write);
+
+    json read = measure("EigenvalueReader", {{"eigenvalues", count}}, 3, 1, [&] {
+        EigenvalueReader reader(raw_file);
+        std::complex<double> sum = 0;
+        for (uint64_t i = 0; i < reader.size(); ++i) {
+            sum += reader.data()[i];
+        }
+        reader.release(0, reader.size());
+        sink = sum.real();
+    });
+    read["megabytes_per_second"] = megabytes * 3 / read["seconds"].get<double>();
+    results.push_back(read);
+    std::remove(raw_file.c_str());
+
+    // Histogram files.
+    const std::string histogram_file = scratch + ".bhist";
+    ImageHistogram histogram(2000, -3, 3, -3, 3);
+    for (const auto& point : points) {
+        histogram.add_point(point);
+    }
+    results.push_back(measure("ImageHistogram::write_to_file", {{"resolution", 2000}}, 3, 1, [&] {
+        histogram.write_to_file(histogram_file, points.size(), "bench");
+    }));
+    results.push_back(measure("ImageHistogram::load_from_file", {{"resolution", 2000}}, 3, 1, [&] {
+        ImageHistogram loaded(2000, -3, 3, -3, 3);
+        loaded.load_from_file(histogram_file);
+    }));
+    std::remove(histogram_file.c_str());
+    return results;
+}
+
+// The sampling pipeline of main.cpp: blocks of tridiagonal matrices, batched
+// solves and tiled binning, on 1..T threads.
+json bench_scaling() {
+    json results = json::array();
+    const uint64_t samples = scaled(100000);
+    for (int threads : thread_counts()) {
+        ImageHistogram histogram(1000, -3, 3, -3, 3);
+        Scheduler scheduler(threads);
+        histogram.set_scheduler(scheduler);
+        std::vector<LocalHistogram> locals;
+        for (int t = 0; t < threads; ++t) {
+            locals.emplace_back(histogram);
+        }
+        BlockDispatcher blocks(samples, 4096, stream_state(3, 0));
+
+        const auto start = Clock::now();
+        scheduler.run_workers([&](int worker) {
+            StaticMatrixGenerator<10, TridiagonalPattern> generator(0);
+            const int n = generator.get_size();
+            const int batch_size = EigenSolver::DEFAULT_BATCH_SIZE;
+            EigenSolver solver(n, generator.get_structure());
+            std::vector<std::complex<double>> matrices(batch_size * solver.matrix_stride());
+            std::vector<std::complex<double>> eigenvalues(batch_size * n);
+            BlockDispatcher::Block block;
+            while (blocks.next(block)) {
+                generator.set_state(block.rng);
+                for (uint64_t i = block.begin; i < block.end; i += batch_size) {
+                    int batch = static_cast<int>(std::min<uint64_t>(batch_size, block.end - i));
+                    generator.generate_batch(matrices.data(), batch);
+                    solver.solve_batch(matrices.data(), batch, eigenvalues.data());
+                    for (int k = 0; k < batch * n; ++k) {
+                        locals[worker].add_point(eigenvalues[k]);
+                    }
+                }
+            }
+        });
+        histogram.merge(locals);
+        const double elapsed = seconds_since(start);
+
+        results.push_back({{"threads", threads}, {"samples", samples}, {"seconds", elapsed},
+                           {"samples_per_second", samples / elapsed}});
+        LOG_INFO << "end-to-end on " << threads << " threads: " << samples / elapsed << " samples/s";
+    }
+    return results;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string output = "bench.json";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quick") {
+            work_scale = 0.1;
+        } else {
+            output = arg;
+        }
+    }
+    const std::string scratch = "bohemia_bench_scratch";
+
+    json stages = json::array();
+    auto append = [&](const json& results) {
+        if (results.is_array()) {
+            for (const auto& result : results) stages.push_back(result);
+        } else {
+            stages.push_back(results);
+        }
+    };
+    append(bench_generators());
+    append(bench_eigensolvers());
+    append(bench_families());
+    append(bench_real_arithmetic());
+    append(bench_reduced_sampling());
+    append(bench_binning());
+    append(bench_pmf());
+    append(bench_render(scratch));
+    append(bench_io(scratch));
+
+    json report = {
+        {"timestamp", std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count()},
+        {"hardware_concurrency", std::thread::hardware_concurrency()},
+        {"work_scale", work_scale},
+        {"stages", stages},
+        {"scaling", bench_scaling()}
+    };
+
+    std::ofstream file(output);
+    if (!file.is_open()) {
+        LOG_ERROR << "Failed to open file for writing: " << output;
+        return 1;
+    }
+    file << report.dump(2) << std::endl;
+    LOG_INFO << "Wrote benchmark results to " << output;
+    return 0;
+}
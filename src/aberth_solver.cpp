@@ -0,0 +1,260 @@
+#include "aberth_solver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+AberthSolver::AberthSolver(int n, int batch_size, MatrixStructure structure)
+    : n(n), structure(structure), lanes((batch_size + GROUP - 1) / GROUP * GROUP),
+      diagonal_re(n * lanes), diagonal_im(n * lanes),
+      coupling_re(n * lanes), coupling_im(n * lanes),
+      root_re(n * lanes), root_im(n * lanes),
+      scale(lanes), done(lanes) {}
+
+/// Starts the roots evenly spread on a circle around the mean eigenvalue
+/// (trace / n) that encloses every Gershgorin disc. The angular offset keeps
+/// the start away from symmetric configurations that can stall the iteration.
+void AberthSolver::initial_guesses(const std::complex<double>* matrices, int count) {
+    const int stride = 3 * n - 2;
+    const double pi = std::acos(-1.0);
+    for (int m = 0; m < lanes; ++m) {
+        // Unused lanes solve a copy of the first matrix and are ignored.
+        const std::complex<double>* values = matrices + (m < count ? m : 0) * stride;
+        const std::complex<double>* sub = values + n;
+        const std::complex<double>* super = values + 2 * n - 1;
+
+        std::complex<double> center = 0;
+        for (int k = 0; k < n; ++k) {
+            center += values[k];
+        }
+        center /= static_cast<double>(n);
+
+        double radius = 0;
+        scale[m] = 0;
+        for (int k = 0; k < n; ++k) {
+            double off_diagonal = 0;
+            if (k > 0) off_diagonal += std::abs(sub[k - 1]);
+            if (k + 1 < n) off_diagonal += std::abs(super[k]);
+            radius = std::max(radius, std::abs(values[k] - center) + off_diagonal);
+            scale[m] = std::max(scale[m], std::abs(values[k]) + off_diagonal);
+
+            diagonal_re[at(k, m)] = values[k].real();
+            diagonal_im[at(k, m)] = values[k].imag();
+            const std::complex<double> coupling = k + 1 < n ? sub[k] * super[k] : 0.0;
+            coupling_re[at(k, m)] = coupling.real();
+            coupling_im[at(k, m)] = coupling.imag();
+        }
+        // Coincident starting points would divide by zero in the Aberth sum.
+        radius = std::max(radius, 1e-3 * (1 + std::abs(center)));
+
+        for (int k = 0; k < n; ++k) {
+            const double angle = 2 * pi * k / n + 0.4;
+            root_re[at(k, m)] = center.real() + radius * std::cos(angle);
+            root_im[at(k, m)] = center.imag() + radius * std::sin(angle);
+        }
+        done[m] = m < count ? 0 : 1;
+    }
+}
+
+/// The roots of x^n + c_{n-1} x^{n-1} + ... + c_0 average -c_{n-1} / n and lie
+/// within 1 + max |c_k| of the origin (Cauchy's bound), which also bounds the
+/// companion matrix's norm. The last column holds -c_k.
+void AberthSolver::initial_guesses_companion(const std::complex<double>* matrices, int count) {
+    const double pi = std::acos(-1.0);
+    for (int m = 0; m < lanes; ++m) {
+        const std::complex<double>* values = matrices + (m < count ? m : 0) * n;
+
+        double largest = 0;
+        for (int k = 0; k < n; ++k) {
+            largest = std::max(largest, std::abs(values[k]));
+            diagonal_re[at(k, m)] = -values[k].real();
+            diagonal_im[at(k, m)] = -values[k].imag();
+        }
+        const std::complex<double> center = values[n - 1] / static_cast<double>(n);
+        const double radius = 1 + largest + std::abs(center);
+        scale[m] = 1 + largest;
+
+        for (int k = 0; k < n; ++k) {
+            const double angle = 2 * pi * k / n + 0.4;
+            root_re[at(k, m)] = center.real() + radius * std::cos(angle);
+            root_im[at(k, m)] = center.imag() + radius * std::sin(angle);
+        }
+        done[m] = m < count ? 0 : 1;
+    }
+}
+
+void AberthSolver::solve_group(int group) {
+    constexpr int G = GROUP;
+    const size_t offset = static_cast<size_t>(group) * n * G;
+    const double* a_re = diagonal_re.data() + offset;
+    const double* a_im = diagonal_im.data() + offset;
+    const double* c_re = coupling_re.data() + offset;
+    const double* c_im = coupling_im.data() + offset;
+    double* x_re = root_re.data() + offset;
+    double* x_im = root_im.data() + offset;
+    const double tolerance = 8 * n * std::numeric_limits<double>::epsilon();
+
+    // Per-lane state lives in local arrays, which the compiler knows alias
+    // nothing else and keeps in vector registers.
+    double step_limit[G];
+    bool frozen[G];
+    for (int m = 0; m < G; ++m) {
+        step_limit[m] = tolerance * scale[group * G + m];
+        frozen[m] = done[group * G + m] != 0;
+    }
+
+    for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+        int accepted[G] = {};
+        for (int i = 0; i < n; ++i) {
+            double* xi_re = x_re + i * G;
+            double* xi_im = x_im + i * G;
+
+            // p(x_i), p'(x_i), and a bound on the magnitudes of the terms
+            // summed for p, and so on its rounding error.
+            double p_re[G], p_im[G], dp_re[G], dp_im[G], bound[G];
+            if (structure == MatrixStructure::Companion) {
+                // Horner's rule, p = p x + c_k and p' = p' x + p, from the
+                // leading coefficient 1 down.
+                for (int m = 0; m < G; ++m) {
+                    p_re[m] = 1;
+                    p_im[m] = 0;
+                    dp_re[m] = 0;
+                    dp_im[m] = 0;
+                    bound[m] = 1;
+                }
+                for (int k = n - 1; k >= 0; --k) {
+                    const double* ck_re = a_re + k * G;
+                    const double* ck_im = a_im + k * G;
+                    for (int m = 0; m < G; ++m) {
+                        const double dnext_re = dp_re[m] * xi_re[m] - dp_im[m] * xi_im[m] + p_re[m];
+                        const double dnext_im = dp_re[m] * xi_im[m] + dp_im[m] * xi_re[m] + p_im[m];
+                        const double next_re = p_re[m] * xi_re[m] - p_im[m] * xi_im[m] + ck_re[m];
+                        const double next_im = p_re[m] * xi_im[m] + p_im[m] * xi_re[m] + ck_im[m];
+                        bound[m] = bound[m] * (std::abs(xi_re[m]) + std::abs(xi_im[m])) +
+                                   std::abs(ck_re[m]) + std::abs(ck_im[m]);
+                        p_re[m] = next_re;
+                        p_im[m] = next_im;
+                        dp_re[m] = dnext_re;
+                        dp_im[m] = dnext_im;
+                    }
+                }
+            } else {
+                // The recurrence
+                //     p_k = d p_{k-1} - c p_{k-2}, p'_k = d p'_{k-1} - p_{k-1} - c p'_{k-2}
+                // with d = a_k - x_i, and the same recurrence on magnitudes.
+                double q_re[G], q_im[G], dq_re[G], dq_im[G], bound_prev[G];  // p_{k-1}, p'_{k-1}
+                for (int m = 0; m < G; ++m) {
+                    q_re[m] = 1;
+                    q_im[m] = 0;
+                    p_re[m] = a_re[m] - xi_re[m];
+                    p_im[m] = a_im[m] - xi_im[m];
+                    dq_re[m] = 0;
+                    dq_im[m] = 0;
+                    dp_re[m] = -1;
+                    dp_im[m] = 0;
+                    bound_prev[m] = 1;
+                    bound[m] = std::abs(p_re[m]) + std::abs(p_im[m]);
+                }
+                for (int k = 1; k < n; ++k) {
+                    const double* ak_re = a_re + k * G;
+                    const double* ak_im = a_im + k * G;
+                    const double* ck_re = c_re + (k - 1) * G;
+                    const double* ck_im = c_im + (k - 1) * G;
+                    for (int m = 0; m < G; ++m) {
+                        const double d_re = ak_re[m] - xi_re[m];
+                        const double d_im = ak_im[m] - xi_im[m];
+                        const double next_re = d_re * p_re[m] - d_im * p_im[m] - (ck_re[m] * q_re[m] - ck_im[m] * q_im[m]);
+                        const double next_im = d_re * p_im[m] + d_im * p_re[m] - (ck_re[m] * q_im[m] + ck_im[m] * q_re[m]);
+                        const double dnext_re = d_re * dp_re[m] - d_im * dp_im[m] - p_re[m] - (ck_re[m] * dq_re[m] - ck_im[m] * dq_im[m]);
+                        const double dnext_im = d_re * dp_im[m] + d_im * dp_re[m] - p_im[m] - (ck_re[m] * dq_im[m] + ck_im[m] * dq_re[m]);
+                        const double c_abs = std::abs(ck_re[m]) + std::abs(ck_im[m]);
+                        const double bound_next = (std::abs(d_re) + std::abs(d_im)) * bound[m] + c_abs * bound_prev[m];
+
+                        q_re[m] = p_re[m];
+                        q_im[m] = p_im[m];
+                        p_re[m] = next_re;
+                        p_im[m] = next_im;
+                        dq_re[m] = dp_re[m];
+                        dq_im[m] = dp_im[m];
+                        dp_re[m] = dnext_re;
+                        dp_im[m] = dnext_im;
+                        bound_prev[m] = bound[m];
+                        bound[m] = bound_next;
+                    }
+                }
+            }
+
+            // Aberth correction sum_{j != i} 1 / (x_i - x_j).
+            double sum_re[G] = {}, sum_im[G] = {};
+            for (int j = 0; j < n; ++j) {
+                if (j == i) {
+                    continue;
+                }
+                const double* xj_re = x_re + j * G;
+                const double* xj_im = x_im + j * G;
+                for (int m = 0; m < G; ++m) {
+                    const double d_re = xi_re[m] - xj_re[m];
+                    const double d_im = xi_im[m] - xj_im[m];
+                    const double inverse = 1 / (d_re * d_re + d_im * d_im);
+                    sum_re[m] += d_re * inverse;
+                    sum_im[m] -= d_im * inverse;
+                }
+            }
+
+            // w = N / (1 - N sum) with the Newton step N = p / p'. Roots are
+            // updated in place, so later roots already see this one's move.
+            for (int m = 0; m < G; ++m) {
+                const double dp_norm = 1 / (dp_re[m] * dp_re[m] + dp_im[m] * dp_im[m]);
+                const double n_re = (p_re[m] * dp_re[m] + p_im[m] * dp_im[m]) * dp_norm;
+                const double n_im = (p_im[m] * dp_re[m] - p_re[m] * dp_im[m]) * dp_norm;
+                const double den_re = 1 - (n_re * sum_re[m] - n_im * sum_im[m]);
+                const double den_im = -(n_re * sum_im[m] + n_im * sum_re[m]);
+                const double den_norm = 1 / (den_re * den_re + den_im * den_im);
+                const double w_re = (n_re * den_re + n_im * den_im) * den_norm;
+                const double w_im = (n_im * den_re - n_re * den_im) * den_norm;
+
+                // Either p vanishes to rounding error, or (as at a multiple root
+                // reached in exact arithmetic) the step is below what LAPACK
+                // resolves, eps times the norm of the matrix.
+                const bool small_residual = std::abs(p_re[m]) + std::abs(p_im[m]) <= tolerance * bound[m];
+                const bool small_step = std::abs(w_re) + std::abs(w_im) <= step_limit[m];
+                accepted[m] += small_residual || small_step;
+                // Converged lanes stay put (and unused ones can't spread NaNs).
+                xi_re[m] -= frozen[m] ? 0.0 : w_re;
+                xi_im[m] -= frozen[m] ? 0.0 : w_im;
+            }
+        }
+
+        bool all_done = true;
+        for (int m = 0; m < G; ++m) {
+            frozen[m] |= accepted[m] == n;
+            all_done &= frozen[m];
+        }
+        if (all_done) {
+            break;
+        }
+    }
+
+    for (int m = 0; m < G; ++m) {
+        done[group * G + m] = frozen[m];
+    }
+}
+
+void AberthSolver::solve_batch(const std::complex<double>* matrices, int count,
+                               std::complex<double>* eigenvalues, bool* converged) {
+    if (structure == MatrixStructure::Companion) {
+        initial_guesses_companion(matrices, count);
+    } else {
+        initial_guesses(matrices, count);
+    }
+    for (int group = 0; group * GROUP < count; ++group) {
+        solve_group(group);
+    }
+
+    for (int m = 0; m < count; ++m) {
+        converged[m] = done[m] != 0;
+        for (int i = 0; i < n; ++i) {
+            eigenvalues[m * n + i] = {root_re[at(i, m)], root_im[at(i, m)]};
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+#include "matrix.h"
+
+// Eigenvalues of tridiagonal or companion matrices as the roots of their
+// characteristic polynomials, for a whole batch of matrices at once.
+//
+// For tridiagonal matrices p(x) = det(A - xI) and p'(x) come straight from
+// the three-term recurrence
+//     p_k = (a_k - x) p_{k-1} - b_{k-1} c_{k-1} p_{k-2},
+// so neither coefficients nor a dense matrix are ever formed. A companion
+// matrix stores its polynomial's coefficients, which are evaluated by Horner's
+// rule. All n roots are
+// refined together by the Aberth-Ehrlich iteration. Matrices are iterated in
+// groups of GROUP, one per SIMD lane: state is kept in structure-of-arrays
+// form (per group, one array of lanes per root and per real/imaginary part),
+// so every step is a fixed-width loop over lanes that the compiler vectorizes,
+// and a group stops as soon as its own matrices have converged. A root is
+// accepted once |p| is within the rounding error of evaluating the
+// recurrence, or once its step drops below eps times the norm of the matrix,
+// which is what catches exactly multiple roots.
+class AberthSolver {
+public:
+    static constexpr int MAX_ITERATIONS = 100;
+    static constexpr int GROUP = 8;
+
+    // `structure` is Tridiagonal or Companion.
+    AberthSolver(int n, int batch_size, MatrixStructure structure = MatrixStructure::Tridiagonal);
+
+    int size() const { return n; }
+
+    // Solves up to batch_size matrices in the structure's storage (see
+    // MatrixStructure), storage_size() values apart, writing n eigenvalues per
+    // matrix. converged[m] is false for matrices whose roots did not all
+    // converge; their eigenvalues are meaningless.
+    void solve_batch(const std::complex<double>* matrices, int count,
+                     std::complex<double>* eigenvalues, bool* converged);
+
+private:
+    int n;
+    MatrixStructure structure;
+    int lanes;  // batch_size rounded up to whole groups
+    // Indexed [(group * n + row) * GROUP + lane], see at().
+    std::vector<double> diagonal_re, diagonal_im;  // a_k, or the coefficient of x^k for companion matrices
+    std::vector<double> coupling_re, coupling_im;  // b_k c_k
+    std::vector<double> root_re, root_im;
+    // Indexed [matrix].
+    std::vector<double> scale;  // Infinity norm
+    std::vector<char> done;
+
+    size_t at(int row, int matrix) const {
+        return (static_cast<size_t>(matrix / GROUP) * n + row) * GROUP + matrix % GROUP;
+    }
+    void initial_guesses(const std::complex<double>* matrices, int count);
+    void initial_guesses_companion(const std::complex<double>* matrices, int count);
+    // Iterates the matrices of one group until all of them have converged.
+    void solve_group(int group);
+};
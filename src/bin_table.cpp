@@ -0,0 +1,77 @@
+#include "bin_table.h"
+
+#include <utility>
+
+void BinTable::add(uint64_t key, uint64_t hash, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+    // Keep the load at most 1/2, where linear probes stay short.
+    if (2 * (used + 1) > slots.size()) {
+        grow();
+    }
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Slot& slot = slots[i];
+        if (slot.count == 0) {
+            slot.key = key;
+            slot.count = count;
+            used++;
+            return;
+        }
+        if (slot.key == key) {
+            slot.count += count;
+            return;
+        }
+    }
+}
+
+uint64_t BinTable::get(uint64_t key) const {
+    if (used == 0) {
+        return 0;
+    }
+    for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+        const Slot& slot = slots[i];
+        if (slot.count == 0) {
+            return 0;
+        }
+        if (slot.key == key) {
+            return slot.count;
+        }
+    }
+}
+
+void BinTable::merge(BinTable& other) {
+    if (empty()) {
+        std::swap(slots, other.slots);
+        std::swap(mask, other.mask);
+        std::swap(used, other.used);
+    } else {
+        other.for_each([&](uint64_t key, uint64_t count) {
+            add(key, count);
+        });
+    }
+    other.clear();
+}
+
+void BinTable::clear() {
+    std::vector<Slot>().swap(slots);
+    mask = 0;
+    used = 0;
+}
+
+void BinTable::grow() {
+    std::vector<Slot> old(slots.empty() ? INITIAL_SLOTS : 2 * slots.size(), Slot{0, 0});
+    std::swap(slots, old);
+    mask = slots.size() - 1;
+    for (const Slot& slot : old) {
+        if (slot.count == 0) {
+            continue;
+        }
+        for (size_t i = hash(slot.key) & mask;; i = (i + 1) & mask) {
+            if (slots[i].count == 0) {
+                slots[i] = slot;
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "util.h"
+
+// Flat open-addressing map from 64-bit bin keys to counts, the storage of
+// EigenvaluePMF.
+//
+// Keys and counts sit side by side in one array that is probed linearly from
+// the slot picked by mix64(key), so an insert touches one or two cache lines
+// and allocates only when the table doubles. Any key is valid; a zero count
+// marks an empty slot. Tables are not thread-safe: each thread fills its own
+// and they are summed with merge().
+class BinTable {
+public:
+    static constexpr size_t INITIAL_SLOTS = 256;
+
+    static uint64_t hash(uint64_t key) { return mix64(key); }
+
+    // Adds `count` to the bin; `hash` must be hash(key).
+    void add(uint64_t key, uint64_t hash, uint64_t count);
+    void add(uint64_t key, uint64_t count) { add(key, hash(key), count); }
+    uint64_t get(uint64_t key) const;
+    size_t size() const { return used; }
+    bool empty() const { return used == 0; }
+    // Adds every bin of `other` and clears it.
+    void merge(BinTable& other);
+    // Drops every bin and frees the slots.
+    void clear();
+
+    // Calls f(key, count) for every bin, in no particular order.
+    template<typename F>
+    void for_each(F&& f) const {
+        for (const Slot& slot : slots) {
+            if (slot.count != 0) {
+                f(slot.key, slot.count);
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        uint64_t key;
+        uint64_t count;
+    };
+
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    size_t used = 0;
+
+    // Doubles the slots (or allocates the first ones) and reinserts.
+    void grow();
+};
@@ -0,0 +1,197 @@
+#include "checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <unistd.h>
+
+#include "histogram_file.h"
+#include "image.h"
+#include "logger.h"
+
+namespace {
+
+constexpr char MAGIC[4] = {'B', 'R', 'U', 'N'};
+
+template<typename T>
+void put(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool get(const std::string& in, size_t& offset, T& value) {
+    if (offset + sizeof(T) > in.size()) {
+        return false;
+    }
+    std::memcpy(&value, in.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+std::string encode(const RunState& state) {
+    std::string out(MAGIC, sizeof(MAGIC));
+    put(out, state.config_hash);
+    put(out, state.samples);
+    put(out, state.completed);
+    for (uint64_t word : state.next_stream) {
+        put(out, word);
+    }
+    put(out, state.generation);
+    return out;
+}
+
+bool decode(const std::string& in, RunState& state) {
+    size_t offset = sizeof(MAGIC);
+    if (in.size() < sizeof(MAGIC) || std::memcmp(in.data(), MAGIC, sizeof(MAGIC)) != 0 ||
+        !get(in, offset, state.config_hash) || !get(in, offset, state.samples) ||
+        !get(in, offset, state.completed)) {
+        return false;
+    }
+    for (uint64_t& word : state.next_stream) {
+        if (!get(in, offset, word)) return false;
+    }
+    return get(in, offset, state.generation) && offset == in.size();
+}
+
+// The run state alone, from the snapshot header.
+bool read_state(const std::string& filename, RunState& state) {
+    if (access(filename.c_str(), F_OK) != 0) {
+        return false;
+    }
+    HistogramReader reader(filename);
+    return reader.is_open() && reader.header().kind == HistogramHeader::Kind::Snapshot &&
+           decode(reader.header().metadata, state);
+}
+
+} // namespace
+
+uint64_t hash_config(const std::string& dumped_config) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : dumped_config) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// The snapshot's HistogramWriter syncs it and moves it into place.
+bool write_checkpoint(const std::string& filename, const ImageHistogram& histogram, const RunState& state) {
+    if (!histogram.write_snapshot(filename, encode(state))) {
+        LOG_ERROR << "Failed to write checkpoint " << filename;
+        return false;
+    }
+    return true;
+}
+
+bool read_checkpoint(const std::string& filename, ImageHistogram& histogram, RunState& state) {
+    std::string metadata;
+    if (!histogram.read_snapshot(filename, metadata)) {
+        return false;
+    }
+    if (!decode(metadata, state)) {
+        LOG_ERROR << "Corrupt run state in checkpoint " << filename;
+        return false;
+    }
+    return true;
+}
+
+bool write_checkpoints(const std::vector<std::string>& filenames,
+                       const std::vector<const ImageHistogram*>& histograms, const RunState& state) {
+    for (size_t k = 0; k < filenames.size(); ++k) {
+        if (!write_checkpoint(filenames[k] + ".next", *histograms[k], state)) {
+            return false;
+        }
+    }
+    for (const auto& filename : filenames) {
+        if (std::rename((filename + ".next").c_str(), filename.c_str()) != 0) {
+            LOG_ERROR << "Failed to move checkpoint into place: " << filename;
+            return false;
+        }
+    }
+    return true;
+}
+
+/// A crash while the .next files are written leaves the previous generation
+/// in every main file; one while they are renamed leaves the new generation
+/// in each file's main or .next copy. Either way the newest generation found
+/// for every file is complete.
+bool read_checkpoints(const std::vector<std::string>& filenames,
+                      const std::vector<ImageHistogram*>& histograms, RunState& state) {
+    std::vector<std::set<uint64_t>> generations(filenames.size());
+    std::set<uint64_t> common;
+    for (size_t k = 0; k < filenames.size(); ++k) {
+        for (const std::string& candidate : {filenames[k], filenames[k] + ".next"}) {
+            RunState candidate_state;
+            if (read_state(candidate, candidate_state)) {
+                generations[k].insert(candidate_state.generation);
+            }
+        }
+        if (k == 0) {
+            common = generations[0];
+        } else {
+            std::set<uint64_t> both;
+            for (uint64_t generation : common) {
+                if (generations[k].count(generation)) both.insert(generation);
+            }
+            common.swap(both);
+        }
+    }
+    if (common.empty()) {
+        LOG_ERROR << "No complete checkpoint in " << filenames.front() << " and its view files";
+        return false;
+    }
+
+    const uint64_t generation = *common.rbegin();
+    for (size_t k = 0; k < filenames.size(); ++k) {
+        RunState candidate_state;
+        const std::string filename = read_state(filenames[k], candidate_state) && candidate_state.generation == generation
+            ? filenames[k] : filenames[k] + ".next";
+        RunState view_state;
+        if (!read_checkpoint(filename, *histograms[k], view_state)) {
+            return false;
+        }
+        if (k > 0 && (view_state.completed != state.completed || view_state.next_stream != state.next_stream)) {
+            LOG_ERROR << "Checkpoint " << filename << " does not match " << filenames.front();
+            return false;
+        }
+        state = view_state;
+    }
+    return true;
+}
+
+void PausePoint::enter() {
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock, [&] { return !requested.load(std::memory_order_relaxed); });
+    active++;
+}
+
+void PausePoint::park() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!requested.load(std::memory_order_relaxed)) {
+        return;
+    }
+    const uint64_t current = generation;
+    parked++;
+    workers_parked.notify_one();
+    released.wait(lock, [&] { return generation != current; });
+}
+
+void PausePoint::retire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    active--;
+    workers_parked.notify_one();
+}
+
+void PausePoint::pause() {
+    std::unique_lock<std::mutex> lock(mutex);
+    requested.store(true, std::memory_order_relaxed);
+    workers_parked.wait(lock, [&] { return parked == active; });
+}
+
+void PausePoint::resume() {
+    std::lock_guard<std::mutex> lock(mutex);
+    requested.store(false, std::memory_order_relaxed);
+    parked = 0;
+    generation++;
+    released.notify_all();
+}
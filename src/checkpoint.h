@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ImageHistogram;
+
+// Everything besides the histogram needed to continue a sampling run. Runs
+// are split into blocks handed out in order (see BlockDispatcher), so the
+// state is where the next block starts and its RNG stream.
+struct RunState {
+    uint64_t config_hash = 0;  // Guards against resuming with a different config
+    uint64_t samples = 0;      // Samples in the whole run
+    uint64_t completed = 0;    // Samples binned, all in finished blocks
+    std::array<uint64_t, 4> next_stream{};  // Xoshiro256++ state of the next block
+    uint64_t generation = 0;   // Counts the checkpoints of a run, see write_checkpoints()
+};
+
+// Hash of a dumped config, stable across builds.
+uint64_t hash_config(const std::string& dumped_config);
+
+// Writes the histogram snapshot and run state to `filename` atomically: the
+// data goes to a temporary file that is synced and then renamed over the old
+// checkpoint, so a crash leaves either the old or the new one intact.
+bool write_checkpoint(const std::string& filename, const ImageHistogram& histogram, const RunState& state);
+// Restores the histogram counts and run state written by write_checkpoint().
+bool read_checkpoint(const std::string& filename, ImageHistogram& histogram, RunState& state);
+
+// Checkpoints several histograms (one per view) as one generation, stamped
+// with state.generation. Every snapshot is first written to filenames[k] +
+// ".next", and the set is renamed into place only once all of them are on
+// disk, so a crash at any point leaves a complete generation in the main and
+// .next files together.
+bool write_checkpoints(const std::vector<std::string>& filenames,
+                       const std::vector<const ImageHistogram*>& histograms, const RunState& state);
+// Restores the newest generation that every file of the set has.
+bool read_checkpoints(const std::vector<std::string>& filenames,
+                      const std::vector<ImageHistogram*>& histograms, RunState& state);
+
+// Lets a coordinator stop all workers at a safe point, e.g. to take a
+// checkpoint. Workers call enter() before taking any work, poll() at every
+// safe point, which is a single relaxed load unless a pause has been
+// requested, and retire() when they are done.
+class PausePoint {
+public:
+    // Waits out a pause in progress, then counts the caller as active.
+    void enter();
+
+    void poll() {
+        if (requested.load(std::memory_order_relaxed)) {
+            park();
+        }
+    }
+    void retire();
+
+    // Returns once every active worker is parked in poll().
+    void pause();
+    void resume();
+
+private:
+    std::mutex mutex;
+    std::condition_variable workers_parked, released;
+    std::atomic<bool> requested{false};
+    int active = 0;
+    int parked = 0;
+    uint64_t generation = 0;
+
+    void park();
+};
@@ -0,0 +1,575 @@
+#include "eigen_solver.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "logger.h"
+
+// Declare the LAPACK routines
+extern "C" {
+    void zgeev_(char* jobvl, char* jobvr, int* n, std::complex<double>* a,
+                int* lda, std::complex<double>* w, std::complex<double>* vl,
+                int* ldvl, std::complex<double>* vr, int* ldvr,
+                std::complex<double>* work, int* lwork, double* rwork,
+                int* info);
+    void zhseqr_(char* job, char* compz, int* n, int* ilo, int* ihi,
+                 std::complex<double>* h, int* ldh, std::complex<double>* w,
+                 std::complex<double>* z, int* ldz, std::complex<double>* work,
+                 int* lwork, int* info);
+    void chseqr_(char* job, char* compz, int* n, int* ilo, int* ihi,
+                 std::complex<float>* h, int* ldh, std::complex<float>* w,
+                 std::complex<float>* z, int* ldz, std::complex<float>* work,
+                 int* lwork, int* info);
+    void zgebal_(char* job, int* n, std::complex<double>* a, int* lda, int* ilo,
+                 int* ihi, double* scale, int* info);
+    void zgehrd_(int* n, int* ilo, int* ihi, std::complex<double>* a, int* lda,
+                 std::complex<double>* tau, std::complex<double>* work, int* lwork, int* info);
+    void zhpevd_(char* jobz, char* uplo, int* n, std::complex<double>* ap,
+                 double* w, std::complex<double>* z, int* ldz,
+                 std::complex<double>* work, int* lwork, double* rwork,
+                 int* lrwork, int* iwork, int* liwork, int* info);
+    void dgeev_(char* jobvl, char* jobvr, int* n, double* a, int* lda,
+                double* wr, double* wi, double* vl, int* ldvl, double* vr,
+                int* ldvr, double* work, int* lwork, int* info);
+    void dhseqr_(char* job, char* compz, int* n, int* ilo, int* ihi,
+                 double* h, int* ldh, double* wr, double* wi, double* z,
+                 int* ldz, double* work, int* lwork, int* info);
+    void dgebal_(char* job, int* n, double* a, int* lda, int* ilo, int* ihi,
+                 double* scale, int* info);
+    void dspevd_(char* jobz, char* uplo, int* n, double* ap, double* w,
+                 double* z, int* ldz, double* work, int* lwork, int* iwork,
+                 int* liwork, int* info);
+}
+
+namespace {
+
+bool is_hessenberg(MatrixStructure structure) {
+    return structure == MatrixStructure::Tridiagonal ||
+           structure == MatrixStructure::UpperHessenberg ||
+           structure == MatrixStructure::Companion;
+}
+
+// Expands the stored entries of a tridiagonal, upper Hessenberg or companion
+// matrix into a column-major n x n matrix `h`, which must be zero elsewhere.
+template<typename T>
+void expand_hessenberg(MatrixStructure structure, int n, const T* values, T* h) {
+    switch (structure) {
+        case MatrixStructure::Tridiagonal:
+            for (int i = 0; i < n; ++i) {
+                h[i * n + i] = values[i];
+            }
+            for (int i = 0; i + 1 < n; ++i) {
+                h[i * n + i + 1] = values[n + i];           // A(i+1, i)
+                h[(i + 1) * n + i] = values[2 * n - 1 + i]; // A(i, i+1)
+            }
+            break;
+        case MatrixStructure::UpperHessenberg:
+            // Stored column by column as well, rows 0 to j+1 of column j.
+            for (int j = 0, k = 0; j < n; ++j) {
+                const int rows = std::min(j + 2, n);
+                std::copy(values + k, values + k + rows, h + j * n);
+                k += rows;
+            }
+            break;
+        case MatrixStructure::Companion:
+            for (int i = 0; i + 1 < n; ++i) {
+                h[i * n + i + 1] = 1;
+            }
+            std::copy(values, values + n, h + (n - 1) * n);
+            break;
+        default:
+            break;
+    }
+}
+
+// Row-major, as solve_dense() expects.
+template<typename T>
+void expand_toeplitz(int n, const T* values, T* a) {
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            a[i * n + j] = values[i - j + n - 1];
+        }
+    }
+}
+
+} // namespace
+
+EigenSolver::EigenSolver(int n, MatrixStructure structure)
+    : n(n), structure_(structure), stride(storage_size(structure, n)) {
+    // Ask LAPACK for the optimal workspace size instead of guessing.
+    std::vector<std::complex<double>> a(n * n), w(n);
+    std::complex<double> query;
+    int info = 0;
+    lwork = -1;
+    if (is_hessenberg(structure_)) {
+        char job = 'E', compz = 'N';
+        int ilo = 1, ihi = n, ldh = n, ldz = 1;
+        zhseqr_(&job, &compz, &this->n, &ilo, &ihi, a.data(), &ldh, w.data(), nullptr,
+                &ldz, &query, &lwork, &info);
+        expanded.assign(n * n, 0);
+        balance_scale.resize(n);
+    } else if (structure_ == MatrixStructure::Hermitian) {
+        char jobz = 'N', uplo = 'U';
+        int ldz = 1, lrwork = -1, liwork = -1;
+        double rquery;
+        int iquery;
+        std::vector<double> real_w(n);
+        zhpevd_(&jobz, &uplo, &this->n, a.data(), real_w.data(), nullptr, &ldz,
+                &query, &lwork, &rquery, &lrwork, &iquery, &liwork, &info);
+        rwork.resize(std::max(static_cast<int>(rquery), std::max(1, n)));
+        iwork.resize(std::max(iquery, 1));
+        real_eigenvalues.resize(n);
+    } else {
+        char jobvl = 'N', jobvr = 'N';
+        int lda = n, ldvl = 1, ldvr = 1;
+        rwork.resize(2 * n);
+        zgeev_(&jobvl, &jobvr, &this->n, a.data(), &lda, w.data(), nullptr,
+               &ldvl, nullptr, &ldvr, &query, &lwork, rwork.data(), &info);
+        if (structure_ == MatrixStructure::Toeplitz) {
+            expanded.assign(n * n, 0);
+        }
+    }
+
+    lwork = std::max(static_cast<int>(query.real()), std::max(1, 2 * n));
+    if (info != 0) {
+        LOG_ERROR << "LAPACK workspace query failed with error code " << info;
+    }
+    work.resize(lwork);
+
+    // The same for the real drivers.
+    std::vector<double> real_a(n * n);
+    double real_query = 0;
+    lwork_real = -1;
+    eigenvalues_re.resize(n);
+    eigenvalues_im.resize(n);
+    if (is_hessenberg(structure_)) {
+        char job = 'E', compz = 'N';
+        int ilo = 1, ihi = n, ldh = n, ldz = 1;
+        dhseqr_(&job, &compz, &this->n, &ilo, &ihi, real_a.data(), &ldh, eigenvalues_re.data(),
+                eigenvalues_im.data(), nullptr, &ldz, &real_query, &lwork_real, &info);
+        expanded_real.assign(n * n, 0);
+    } else if (structure_ == MatrixStructure::Hermitian) {
+        char jobz = 'N', uplo = 'U';
+        int ldz = 1, liwork = -1, iquery;
+        dspevd_(&jobz, &uplo, &this->n, real_a.data(), eigenvalues_re.data(), nullptr, &ldz,
+                &real_query, &lwork_real, &iquery, &liwork, &info);
+        iwork.resize(std::max(iwork.size(), static_cast<size_t>(std::max(iquery, 1))));
+    } else {
+        char jobvl = 'N', jobvr = 'N';
+        int lda = n, ldvl = 1, ldvr = 1;
+        dgeev_(&jobvl, &jobvr, &this->n, real_a.data(), &lda, eigenvalues_re.data(), eigenvalues_im.data(),
+               nullptr, &ldvl, nullptr, &ldvr, &real_query, &lwork_real, &info);
+        if (structure_ == MatrixStructure::Toeplitz) {
+            expanded_real.assign(n * n, 0);
+        }
+    }
+    lwork_real = std::max(static_cast<int>(real_query), std::max(1, 3 * n));
+    if (info != 0) {
+        LOG_ERROR << "LAPACK workspace query failed with error code " << info;
+    }
+    work_real.resize(lwork_real);
+}
+
+void EigenSolver::use_mixed_precision(double tolerance) {
+    if (tolerance > 0 && structure_ != MatrixStructure::Dense && structure_ != MatrixStructure::Tridiagonal) {
+        LOG_ERROR << "Mixed precision supports dense and tridiagonal matrices only; keeping double precision";
+        return;
+    }
+    mixed_tolerance = tolerance;
+    if (tolerance <= 0 || !work_single.empty()) {
+        return;
+    }
+
+    std::vector<std::complex<float>> a(n * n), w(n);
+    std::complex<float> query;
+    int info = 0;
+    lwork_single = -1;
+    char job = 'E', compz = 'N';
+    int ilo = 1, ihi = n, ldh = n, ldz = 1;
+    chseqr_(&job, &compz, &n, &ilo, &ihi, a.data(), &ldh, w.data(), nullptr,
+            &ldz, &query, &lwork_single, &info);
+    if (info != 0) {
+        LOG_ERROR << "LAPACK workspace query failed with error code " << info;
+    }
+
+    lwork_single = std::max(static_cast<int>(query.real()), std::max(1, 2 * n));
+    work_single.resize(lwork_single);
+    matrix_single.resize(n * n);
+    eigenvalues_single.resize(n);
+    if (structure_ == MatrixStructure::Dense) {
+        std::complex<double> reduce_query;
+        int ilo = 1, ihi = n, lda = n;
+        lwork_reduce = -1;
+        reflectors.resize(std::max(1, n - 1));
+        zgehrd_(&n, &ilo, &ihi, nullptr, &lda, reflectors.data(), &reduce_query, &lwork_reduce, &info);
+        lwork_reduce = std::max(static_cast<int>(reduce_query.real()), std::max(1, n));
+        work_reduce.resize(lwork_reduce);
+        balance_scale.resize(n);
+        hessenberg.resize(n * n);
+        factor.resize(n * n);
+        multipliers.resize(n);
+        right.resize(n);
+        left.resize(n);
+        swapped.resize(n);
+    }
+}
+
+bool EigenSolver::use_aberth() {
+    if (structure_ != MatrixStructure::Tridiagonal && structure_ != MatrixStructure::Companion) {
+        LOG_ERROR << "The Aberth engine needs tridiagonal or companion matrices; keeping LAPACK";
+        return false;
+    }
+    aberth = std::make_unique<AberthSolver>(n, DEFAULT_BATCH_SIZE, structure_);
+    aberth_converged = std::make_unique<bool[]>(DEFAULT_BATCH_SIZE);
+    return true;
+}
+
+bool EigenSolver::solve(std::complex<double>* values, std::complex<double>* eigenvalues) {
+    if (mixed_tolerance > 0) {
+        if (solve_mixed(values, eigenvalues)) {
+            return true;
+        }
+        fallbacks++;
+    }
+    return solve_double(values, eigenvalues);
+}
+
+bool EigenSolver::solve_double(std::complex<double>* values, std::complex<double>* eigenvalues) {
+    bool ok;
+    switch (structure_) {
+        case MatrixStructure::Tridiagonal:
+        case MatrixStructure::UpperHessenberg:
+        case MatrixStructure::Companion:
+            ok = solve_hessenberg(values, eigenvalues);
+            break;
+        case MatrixStructure::Toeplitz:
+            ok = solve_toeplitz(values, eigenvalues);
+            break;
+        case MatrixStructure::Hermitian:
+            ok = solve_hermitian(values, eigenvalues);
+            break;
+        case MatrixStructure::Dense:
+        default:
+            ok = solve_dense(values, eigenvalues);
+            break;
+    }
+    if (!ok) {
+        std::fill(eigenvalues, eigenvalues + n, std::complex<double>(0, 0));
+    }
+    return ok;
+}
+
+int EigenSolver::solve_batch(std::complex<double>* matrices, int count, std::complex<double>* eigenvalues) {
+    int failures = 0;
+    if (aberth) {
+        for (int begin = 0; begin < count; begin += DEFAULT_BATCH_SIZE) {
+            const int chunk = std::min(DEFAULT_BATCH_SIZE, count - begin);
+            aberth->solve_batch(matrices + begin * stride, chunk, eigenvalues + begin * n, aberth_converged.get());
+            for (int i = 0; i < chunk; ++i) {
+                if (!aberth_converged[i]) {
+                    fallbacks++;
+                    failures += !solve_double(matrices + (begin + i) * stride, eigenvalues + (begin + i) * n);
+                }
+            }
+        }
+        return failures;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!solve(matrices + i * stride, eigenvalues + i * n)) {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+bool EigenSolver::solve(double* values, std::complex<double>* eigenvalues) {
+    int info;
+    const char* routine;
+    if (is_hessenberg(structure_)) {
+        char job = 'E', compz = 'N';
+        int ilo = 1, ihi = n, ldh = n, ldz = 1;
+        double* h = expanded_real.data();
+        std::fill(expanded_real.begin(), expanded_real.end(), 0.0);
+        expand_hessenberg(structure_, n, values, h);
+        if (structure_ != MatrixStructure::Tridiagonal) {
+            char balance = 'S';
+            dgebal_(&balance, &n, h, &ldh, &ilo, &ihi, balance_scale.data(), &info);
+        }
+        dhseqr_(&job, &compz, &n, &ilo, &ihi, h, &ldh, eigenvalues_re.data(), eigenvalues_im.data(),
+                nullptr, &ldz, work_real.data(), &lwork_real, &info);
+        routine = "DHSEQR";
+    } else if (structure_ == MatrixStructure::Hermitian) {
+        // A real Hermitian matrix is symmetric.
+        char jobz = 'N', uplo = 'U';
+        int ldz = 1, liwork = static_cast<int>(iwork.size());
+        dspevd_(&jobz, &uplo, &n, values, eigenvalues_re.data(), nullptr, &ldz,
+                work_real.data(), &lwork_real, iwork.data(), &liwork, &info);
+        std::fill(eigenvalues_im.begin(), eigenvalues_im.end(), 0.0);
+        routine = "DSPEVD";
+    } else {
+        char jobvl = 'N', jobvr = 'N';
+        int lda = n, ldvl = 1, ldvr = 1;
+        double* a = values;
+        if (structure_ == MatrixStructure::Toeplitz) {
+            a = expanded_real.data();
+            expand_toeplitz(n, values, a);
+        }
+        dgeev_(&jobvl, &jobvr, &n, a, &lda, eigenvalues_re.data(), eigenvalues_im.data(),
+               nullptr, &ldvl, nullptr, &ldvr, work_real.data(), &lwork_real, &info);
+        routine = "DGEEV";
+    }
+
+    if (info != 0) {
+        LOG_ERROR << routine << " failed with error code " << info;
+        std::fill(eigenvalues, eigenvalues + n, std::complex<double>(0, 0));
+        return false;
+    }
+    for (int i = 0; i < n; ++i) {
+        eigenvalues[i] = {eigenvalues_re[i], eigenvalues_im[i]};
+    }
+    return true;
+}
+
+int EigenSolver::solve_batch(double* matrices, int count, std::complex<double>* eigenvalues) {
+    int failures = 0;
+    for (int i = 0; i < count; ++i) {
+        if (!solve(matrices + i * stride, eigenvalues + i * n)) {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+bool EigenSolver::solve_dense(std::complex<double>* values, std::complex<double>* eigenvalues) {
+    char jobvl = 'N', jobvr = 'N';
+    int lda = n, ldvl = 1, ldvr = 1, info;
+
+    // Row-major storage hands zgeev the transpose, which has the same eigenvalues.
+    zgeev_(&jobvl, &jobvr, &n, values, &lda, eigenvalues, nullptr,
+           &ldvl, nullptr, &ldvr, work.data(), &lwork, rwork.data(), &info);
+
+    if (info != 0) {
+        LOG_ERROR << "ZGEEV failed with error code " << info;
+        return false;
+    }
+    return true;
+}
+
+/// Tridiagonal, upper Hessenberg and companion matrices are already upper
+/// Hessenberg, so we can skip zgeev's balancing and Hessenberg reduction and
+/// run the QR iteration in zhseqr directly.
+bool EigenSolver::solve_hessenberg(const std::complex<double>* values, std::complex<double>* eigenvalues) {
+    char job = 'E', compz = 'N';
+    int ilo = 1, ihi = n, ldh = n, ldz = 1, info;
+    std::complex<double>* h = expanded.data();
+
+    // zhseqr leaves garbage in the upper triangle, so clear it first.
+    std::fill(expanded.begin(), expanded.end(), std::complex<double>(0, 0));
+    expand_hessenberg(structure_, n, values, h);
+    if (structure_ != MatrixStructure::Tridiagonal) {
+        // Companion and general Hessenberg matrices can be badly scaled, which
+        // zgeev would balance away. Scaling alone keeps the Hessenberg form.
+        char balance = 'S';
+        zgebal_(&balance, &n, h, &ldh, &ilo, &ihi, balance_scale.data(), &info);
+    }
+
+    zhseqr_(&job, &compz, &n, &ilo, &ihi, h, &ldh, eigenvalues, nullptr,
+            &ldz, work.data(), &lwork, &info);
+
+    if (info != 0) {
+        LOG_ERROR << "ZHSEQR failed with error code " << info;
+        return false;
+    }
+    return true;
+}
+
+/// Toeplitz matrices have no cheaper eigenvalue algorithm in LAPACK; their
+/// 2n-1 stored values are expanded and solved densely.
+bool EigenSolver::solve_toeplitz(const std::complex<double>* values, std::complex<double>* eigenvalues) {
+    expand_toeplitz(n, values, expanded.data());
+    return solve_dense(expanded.data(), eigenvalues);
+}
+
+/// zhpevd works on the packed upper triangle as stored, reducing it to a real
+/// symmetric tridiagonal matrix and solving that by divide and conquer. The
+/// eigenvalues are real, returned in ascending order.
+bool EigenSolver::solve_hermitian(std::complex<double>* values, std::complex<double>* eigenvalues) {
+    char jobz = 'N', uplo = 'U';
+    int ldz = 1, lrwork = static_cast<int>(rwork.size()), liwork = static_cast<int>(iwork.size()), info;
+
+    // Only the real part of the diagonal counts.
+    for (int j = 0; j < n; ++j) {
+        std::complex<double>& diagonal = values[j * (j + 3) / 2];
+        diagonal = diagonal.real();
+    }
+    zhpevd_(&jobz, &uplo, &n, values, real_eigenvalues.data(), nullptr, &ldz,
+            work.data(), &lwork, rwork.data(), &lrwork, iwork.data(), &liwork, &info);
+
+    if (info != 0) {
+        LOG_ERROR << "ZHPEVD failed with error code " << info;
+        return false;
+    }
+    std::copy(real_eigenvalues.begin(), real_eigenvalues.end(), eigenvalues);
+    return true;
+}
+
+bool EigenSolver::solve_mixed(const std::complex<double>* values, std::complex<double>* eigenvalues) {
+    std::complex<float>* a = matrix_single.data();
+    std::complex<float>* w = eigenvalues_single.data();
+    char job = 'E', compz = 'N';
+    int ilo = 1, ihi = n, ldh = n, ldz = 1, info;
+    if (structure_ == MatrixStructure::Tridiagonal) {
+        std::fill(matrix_single.begin(), matrix_single.end(), std::complex<float>(0, 0));
+        for (int i = 0; i < n; ++i) {
+            a[i * n + i] = std::complex<float>(values[i]);
+        }
+        for (int i = 0; i + 1 < n; ++i) {
+            a[i * n + i + 1] = std::complex<float>(values[n + i]);
+            a[(i + 1) * n + i] = std::complex<float>(values[2 * n - 1 + i]);
+        }
+    } else {
+        // Balance and reduce in double, as zgeev would, so that the check can
+        // run on the same Hessenberg matrix chseqr sees.
+        char balance = 'B';
+        std::complex<double>* h = hessenberg.data();
+        std::copy(values, values + n * n, h);
+        zgebal_(&balance, &n, h, &ldh, &ilo, &ihi, balance_scale.data(), &info);
+        zgehrd_(&n, &ilo, &ihi, h, &ldh, reflectors.data(), work_reduce.data(), &lwork_reduce, &info);
+        if (info != 0) {
+            return false;
+        }
+        for (int column = 0; column < n; ++column) {
+            for (int row = column + 2; row < n; ++row) {
+                h[column * n + row] = 0;  // Householder vectors
+            }
+        }
+        std::copy(h, h + n * n, a);
+    }
+    chseqr_(&job, &compz, &n, &ilo, &ihi, a, &ldh, w, nullptr,
+            &ldz, work_single.data(), &lwork_single, &info);
+    if (info != 0) {
+        return false;
+    }
+
+    std::copy(w, w + n, eigenvalues);
+    return structure_ == MatrixStructure::Tridiagonal
+        ? check_tridiagonal(values, eigenvalues)
+        : check_dense(eigenvalues);
+}
+
+/// Evaluates p(x) = det(A - xI) and p'(x) with the three-term recurrence of a
+/// tridiagonal determinant and takes one Newton step x - p/p'. The step is an
+/// estimate of the eigenvalue's error: small steps are applied, and a single
+/// large one rejects the whole matrix.
+bool EigenSolver::check_tridiagonal(const std::complex<double>* values, std::complex<double>* eigenvalues) const {
+    const std::complex<double>* diagonal = values;
+    const std::complex<double>* sub = values + n;
+    const std::complex<double>* super = values + 2 * n - 1;
+    for (int k = 0; k < n; ++k) {
+        const std::complex<double> x = eigenvalues[k];
+        std::complex<double> p_prev = 1, p = diagonal[0] - x;
+        std::complex<double> dp_prev = 0, dp = -1;
+        for (int i = 1; i < n; ++i) {
+            const std::complex<double> coupling = sub[i - 1] * super[i - 1];
+            const std::complex<double> p_next = (diagonal[i] - x) * p - coupling * p_prev;
+            const std::complex<double> dp_next = (diagonal[i] - x) * dp - p - coupling * dp_prev;
+            p_prev = p;
+            p = p_next;
+            dp_prev = dp;
+            dp = dp_next;
+            // Only the ratio p/p' matters, so rescale before anything overflows.
+            const double magnitude = std::max(std::abs(p), std::abs(dp));
+            if (magnitude > 1e100) {
+                p /= magnitude;
+                p_prev /= magnitude;
+                dp /= magnitude;
+                dp_prev /= magnitude;
+            }
+        }
+        const std::complex<double> step = p / dp;
+        if (!(std::abs(step) <= mixed_tolerance)) {
+            return false;
+        }
+        eigenvalues[k] = x - step;
+    }
+    return true;
+}
+
+/// Solves (H - xI) r = e and (H - xI)^H l = e in double for each eigenvalue x
+/// of the Hessenberg form H, which takes O(n^2) with a Hessenberg LU. That one
+/// step of inverse iteration makes r and l right and left eigenvectors, and the
+/// Rayleigh quotient l^H (H - xI) r / l^H r = sum(conj(l)) / l^H r is the
+/// eigenvalue's error, including the 1 / |l^H r| conditioning that checks on
+/// tr(A) and tr(A^2) never see. Near a defective eigenvalue the step stays
+/// within a factor of two of the error. As in check_tridiagonal(), small steps
+/// are applied and one large step rejects the matrix.
+bool EigenSolver::check_dense(std::complex<double>* eigenvalues) {
+    const std::complex<double>* h = hessenberg.data();
+    std::complex<double>* u = factor.data();
+    for (int k = 0; k < n; ++k) {
+        const std::complex<double> x = eigenvalues[k];
+        std::copy(h, h + n * n, u);
+        for (int i = 0; i < n; ++i) {
+            u[i * n + i] -= x;
+        }
+        // Gaussian elimination only has the sub-diagonal to clear, and partial
+        // pivoting only ever swaps neighbouring rows.
+        bool singular = false;
+        for (int i = 0; i + 1 < n; ++i) {
+            swapped[i] = std::abs(u[i * n + i + 1]) > std::abs(u[i * n + i]);
+            if (swapped[i]) {
+                for (int column = i; column < n; ++column) {
+                    std::swap(u[column * n + i], u[column * n + i + 1]);
+                }
+            }
+            if (u[i * n + i] == 0.0) {
+                singular = true;
+                break;
+            }
+            multipliers[i] = u[i * n + i + 1] / u[i * n + i];
+            for (int column = i + 1; column < n; ++column) {
+                u[column * n + i + 1] -= multipliers[i] * u[column * n + i];
+            }
+        }
+        if (singular || u[(n - 1) * n + n - 1] == 0.0) {
+            continue;  // H - xI is singular in double: x is as good as it gets
+        }
+
+        // r = U^-1 L^-1 e, with L^-1 applied as the recorded eliminations.
+        std::fill(right.begin(), right.end(), std::complex<double>(1, 0));
+        for (int i = 0; i + 1 < n; ++i) {
+            if (swapped[i]) std::swap(right[i], right[i + 1]);
+            right[i + 1] -= multipliers[i] * right[i];
+        }
+        for (int i = n - 1; i >= 0; --i) {
+            for (int column = i + 1; column < n; ++column) {
+                right[i] -= u[column * n + i] * right[column];
+            }
+            right[i] /= u[i * n + i];
+        }
+        // l = L^-H U^-H e, the same steps transposed and in reverse.
+        std::fill(left.begin(), left.end(), std::complex<double>(1, 0));
+        for (int i = 0; i < n; ++i) {
+            for (int row = 0; row < i; ++row) {
+                left[i] -= std::conj(u[i * n + row]) * left[row];
+            }
+            left[i] /= std::conj(u[i * n + i]);
+        }
+        for (int i = n - 2; i >= 0; --i) {
+            left[i] -= std::conj(multipliers[i]) * left[i + 1];
+            if (swapped[i]) std::swap(left[i], left[i + 1]);
+        }
+
+        std::complex<double> numerator = 0, denominator = 0;
+        for (int i = 0; i < n; ++i) {
+            numerator += std::conj(left[i]);
+            denominator += std::conj(left[i]) * right[i];
+        }
+        const std::complex<double> step = numerator / denominator;
+        if (!(std::abs(step) <= mixed_tolerance)) {
+            return false;
+        }
+        eigenvalues[k] = x + step;
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <memory>
+
+#include "matrix.h"
+#include "aberth_solver.h"
+
+// Per-thread eigenvalue solver for matrices of one size and structure.
+// Owns the LAPACK workspace (sized by a workspace query up front), so solving
+// a matrix never touches the heap. Not thread-safe; give each worker its own.
+//
+// Each structure goes to the LAPACK driver that exploits it: tridiagonal,
+// upper Hessenberg and companion matrices skip the Hessenberg reduction
+// (zhseqr), Hermitian ones are solved as such from packed storage (zhpevd),
+// and dense and Toeplitz matrices use the general zgeev.
+//
+// With use_mixed_precision() matrices are first solved in single precision
+// (chseqr) and checked in double: tridiagonal eigenvalues get a Newton
+// step on the characteristic polynomial, which both refines them and bounds
+// their error. Dense ones are balanced and reduced to Hessenberg form in
+// double, solved with chseqr and checked with one step of inverse iteration per
+// eigenvalue, whose Rayleigh quotient does the same. Matrices failing the check
+// are solved again in double precision.
+//
+// With use_aberth() tridiagonal and companion batches are solved as polynomial roots by an
+// AberthSolver instead, again falling back to LAPACK for matrices it cannot
+// converge on.
+class EigenSolver {
+public:
+    static constexpr int DEFAULT_BATCH_SIZE = 64;
+
+    EigenSolver(int n, MatrixStructure structure);
+
+    int size() const { return n; }
+    MatrixStructure structure() const { return structure_; }
+    // Number of values one matrix occupies in a batch buffer.
+    int matrix_stride() const { return stride; }
+
+    // Computes the n eigenvalues of the matrix stored in `values` (in the layout
+    // given by the structure). The input is overwritten. On failure the
+    // eigenvalues are set to zero and false is returned.
+    bool solve(std::complex<double>* values, std::complex<double>* eigenvalues);
+
+    // Solves `count` matrices stored back to back in `matrices`, matrix_stride()
+    // values apart, writing n eigenvalues per matrix to `eigenvalues`.
+    // Returns the number of matrices that failed to converge.
+    int solve_batch(std::complex<double>* matrices, int count, std::complex<double>* eigenvalues);
+
+    // The same for matrices with real entries, in real arithmetic (dhseqr,
+    // dspevd or dgeev): half the memory traffic and about a quarter of the
+    // flops. Complex eigenvalues come out in conjugate pairs, and real ones
+    // have an imaginary part of exactly 0. Always double precision LAPACK.
+    bool solve(double* values, std::complex<double>* eigenvalues);
+    int solve_batch(double* matrices, int count, std::complex<double>* eigenvalues);
+
+    // Solves in single precision first, accepting eigenvalues whose estimated
+    // error is at most `tolerance`. A tolerance of 0 switches back to double.
+    // Dense and tridiagonal matrices only; others stay in double precision.
+    void use_mixed_precision(double tolerance);
+    // Finds tridiagonal or companion eigenvalues with the batched Aberth root
+    // finder. Returns false (and keeps LAPACK) for other structures.
+    bool use_aberth();
+    // Matrices the mixed-precision or Aberth path handed back to LAPACK in
+    // double precision.
+    uint64_t double_fallbacks() const { return fallbacks; }
+
+private:
+    int n;
+    MatrixStructure structure_;
+    int stride;
+    int lwork;
+    std::vector<std::complex<double>> work;
+    std::vector<double> rwork;
+    std::vector<int> iwork;
+    std::vector<std::complex<double>> expanded;  // Full n x n copy of structured storage
+    std::vector<double> real_eigenvalues;        // Hermitian only
+    std::vector<double> balance_scale;           // zgebal's row and column scaling
+
+    // Real counterparts.
+    int lwork_real;
+    std::vector<double> work_real;
+    std::vector<double> expanded_real;
+    std::vector<double> eigenvalues_re, eigenvalues_im;
+
+    // Single-precision counterparts, allocated by use_mixed_precision().
+    double mixed_tolerance = 0;
+    uint64_t fallbacks = 0;
+    int lwork_single = 0;
+    std::vector<std::complex<float>> work_single;
+    std::vector<std::complex<float>> matrix_single;  // Hessenberg form of the input
+    std::vector<std::complex<float>> eigenvalues_single;
+    // Dense matrices: zgehrd workspace, the double Hessenberg form and check_dense() scratch.
+    int lwork_reduce = 0;
+    std::vector<std::complex<double>> work_reduce, reflectors;
+    std::vector<std::complex<double>> hessenberg, factor, multipliers, right, left;
+    std::vector<char> swapped;
+
+    std::unique_ptr<AberthSolver> aberth;
+    std::unique_ptr<bool[]> aberth_converged;
+
+    bool solve_double(std::complex<double>* values, std::complex<double>* eigenvalues);
+    bool solve_dense(std::complex<double>* values, std::complex<double>* eigenvalues);
+    bool solve_hessenberg(const std::complex<double>* values, std::complex<double>* eigenvalues);
+    bool solve_toeplitz(const std::complex<double>* values, std::complex<double>* eigenvalues);
+    bool solve_hermitian(std::complex<double>* values, std::complex<double>* eigenvalues);
+    // Leave `values` intact, so a rejected matrix can be solved again in double.
+    bool solve_mixed(const std::complex<double>* values, std::complex<double>* eigenvalues);
+    bool check_tridiagonal(const std::complex<double>* values, std::complex<double>* eigenvalues) const;
+    bool check_dense(std::complex<double>* eigenvalues);
+};
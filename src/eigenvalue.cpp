@@ -1,9 +1,13 @@
 #include "eigenvalue.h"
 
-#include <thread>
-#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <utility>
 
+#include "eigen_solver.h"
+#include "histogram_file.h"
 #include "logger.h"
+#include "scheduler.h"
 
 std::complex<int> EigenvaluePMF::discretize(const std::complex<double>& eigenvalue) const {
     return {
@@ -12,79 +16,136 @@ std::complex<int> EigenvaluePMF::discretize(const std::complex<double>& eigenval
     };
 }
 
-void EigenvaluePMF::insert(const std::complex<double>& eigenvalue) {
-    auto discretized_eigenvalue = discretize(eigenvalue);
-    bins[discretized_eigenvalue].fetch_add(1, std::memory_order_relaxed);
+void EigenvaluePMF::insert(const std::complex<double>& eigenvalue, uint64_t count) {
+    const uint64_t key = pack(discretize(eigenvalue));
+    const uint64_t hash = BinTable::hash(key);
+    shards[shard_of(hash)].add(key, hash, count);
 }
 
-void EigenvaluePMF::compute_eigenvalues(int thread_id, int num_samples, MatrixGenerator thread_local_generator, std::atomic<int>& progress, EigenvaluePMF& pmf) {
-    for (int i = 0; i < num_samples; i++) {
-        auto matrix = thread_local_generator.generate();
-        auto eigenvalues = matrix.compute_eigenvalues();
-        for (const auto& eigenvalue : eigenvalues) {
+LocalPMF::LocalPMF(const EigenvaluePMF& pmf) : target(&pmf), shards(EigenvaluePMF::SHARDS) {}
+
+/// Shards are reduced in parallel, one shard index per task, as
+/// ImageHistogram::merge() does with tiles.
+void EigenvaluePMF::merge(std::vector<LocalPMF>& locals, Scheduler& scheduler) {
+    if (locals.empty()) {
+        return;
+    }
+
+    scheduler.parallel_for(SHARDS, 1, [&](int, uint64_t begin, uint64_t end) {
+        for (uint64_t shard = begin; shard < end; ++shard) {
+            for (auto& local : locals) {
+                shards[shard].merge(local.shards[shard]);
+            }
+        }
+    });
+}
+
+/// Each worker maps the shards it is handed into its own LocalPMF; the
+/// images of a bin can land in any shard.
+void EigenvaluePMF::apply_symmetry(const SymmetryGroup& symmetry, Scheduler& scheduler) {
+    if (symmetry.is_trivial()) {
+        return;
+    }
+
+    std::vector<LocalPMF> images;
+    for (int i = 0; i < scheduler.thread_count(); ++i) {
+        images.emplace_back(*this);
+    }
+    scheduler.parallel_for(SHARDS, 1, [&](int worker, uint64_t begin, uint64_t end) {
+        std::vector<std::complex<double>> orbit(symmetry.order());
+        for (uint64_t shard = begin; shard < end; ++shard) {
+            for_each_bin(static_cast<int>(shard), [&](const std::complex<int>& bin, uint64_t count) {
+                // Quarter turns and reflections of integer points are exact.
+                symmetry.orbit(std::complex<double>(bin.real(), bin.imag()), orbit.data());
+                for (const auto& image : orbit) {
+                    images[worker].insert_bin({static_cast<int>(image.real()), static_cast<int>(image.imag())}, count);
+                }
+            });
+            shards[shard].clear();
+        }
+    });
+    merge(images, scheduler);
+}
+
+void EigenvaluePMF::compute_eigenvalues(int thread_id, uint64_t num_samples, MatrixGenerator thread_local_generator, std::atomic<uint64_t>& progress, LocalPMF& pmf) {
+    const int n = thread_local_generator.get_size();
+    const int batch_size = EigenSolver::DEFAULT_BATCH_SIZE;
+    EigenSolver solver(n, thread_local_generator.get_structure());
+    std::vector<std::complex<double>> matrices(batch_size * solver.matrix_stride());
+    std::vector<std::complex<double>> eigenvalues(batch_size * n);
+
+    for (uint64_t i = 0; i < num_samples; i += batch_size) {
+        int batch = static_cast<int>(std::min<uint64_t>(batch_size, num_samples - i));
+        thread_local_generator.generate_batch(matrices.data(), batch);
+        solver.solve_batch(matrices.data(), batch, eigenvalues.data());
+        for (int k = 0; k < batch * n; k++) {
             // TODO: Ignore real eigenvalues.
-            if (eigenvalue.imag() == 0) {
+            if (eigenvalues[k].imag() == 0) {
                 continue;
             }
-            pmf.insert(eigenvalue);
+            pmf.insert(eigenvalues[k]);
         }
+        progress += batch;
     }
 }
 
 void EigenvaluePMF::get_max_count() {
-    for (const auto& bin : bins) {
-        auto count = bin.second.load(std::memory_order_relaxed);
-        if (count > max_count) {
-            max_count = count;
-        }
-        total_eigenvalues += count;
+    for (const auto& shard : shards) {
+        shard.for_each([&](uint64_t, uint64_t count) {
+            max_count = std::max(max_count, count);
+            total_eigenvalues += count;
+        });
     }
 
     LOG_DEBUG << "Max count: " << max_count;
     LOG_DEBUG << "Total eigenvalues: " << total_eigenvalues;
 }
 
-EigenvaluePMF EigenvaluePMF::compute_pmf(const MatrixGenerator& generator, int num_samples, int precision) {
+EigenvaluePMF EigenvaluePMF::compute_pmf(const MatrixGenerator& generator, uint64_t num_samples, int precision, int threads) {
     double discretization_factor = 1.0 / std::pow(10, precision);
     auto pmf = EigenvaluePMF(generator, discretization_factor);
 
-    int num_threads = std::thread::hardware_concurrency();
-    int samples_per_thread = num_samples / num_threads;
-    LOG_DEBUG << "Num threads: " << num_threads;
-    LOG_DEBUG << "Samples per thread: " << samples_per_thread;
+    Scheduler scheduler(threads);
+    LOG_DEBUG << "Num threads: " << scheduler.thread_count();
 
-    std::vector<std::thread> worker_threads;
-    std::atomic<int> progress(0);
-
-    // Spawn threads
-    for (int i = 0; i < num_threads; i++) {
-        worker_threads.push_back(std::thread(&EigenvaluePMF::compute_eigenvalues, i, samples_per_thread, generator, std::ref(progress), std::ref(pmf)));
-    }
-    
-    LOG_DEBUG << "Launched eigenvalue computation threads.";
-
-    // Join threads
-    for (auto& thread : worker_threads) {
-        thread.join();
+    // Chunks of a few batches are handed out dynamically, so every sample is
+    // drawn and slow threads take fewer chunks.
+    std::atomic<uint64_t> progress(0);
+    std::vector<LocalPMF> locals;
+    for (int i = 0; i < scheduler.thread_count(); i++) {
+        locals.emplace_back(pmf);
     }
+    scheduler.parallel_for(num_samples, 16 * EigenSolver::DEFAULT_BATCH_SIZE, [&](int thread_id, uint64_t begin, uint64_t end) {
+        compute_eigenvalues(thread_id, end - begin, generator, progress, locals[thread_id]);
+    });
+    pmf.merge(locals, scheduler);
 
-    LOG_DEBUG << "Joined eigenvalue computation threads.";
+    LOG_DEBUG << "Computed eigenvalues of " << progress.load() << " matrices.";
 
     pmf.get_max_count();
 
     return pmf;
 }
 
+EigenvaluePMF EigenvaluePMF::with_precision(int precision) {
+    return EigenvaluePMF(MatrixGenerator(0, nullptr), 1.0 / std::pow(10, precision));
+}
+
 EigenvaluePMF::EigenvaluePMF(const MatrixGenerator& generator, double discretization_factor) 
-    : generator(generator), discretization_factor(discretization_factor) {
+    : generator(generator), discretization_factor(discretization_factor), shards(SHARDS) {
 }
 
 uint64_t EigenvaluePMF::get_count(const std::complex<int>& discretized_eigenvalue) const {
-    auto it = bins.find(discretized_eigenvalue);
-    if (it != bins.end()) {
-        return it->second.load(std::memory_order_relaxed);
+    const uint64_t key = pack(discretized_eigenvalue);
+    return shards[shard_of(BinTable::hash(key))].get(key);
+}
+
+size_t EigenvaluePMF::bin_count() const {
+    size_t count = 0;
+    for (const auto& shard : shards) {
+        count += shard.size();
     }
-    return 0;
+    return count;
 }
 
 std::complex<double> EigenvaluePMF::undiscretize(const std::complex<int>& discretized_value) const {
@@ -92,4 +153,71 @@ std::complex<double> EigenvaluePMF::undiscretize(const std::complex<int>& discre
         discretized_value.real() * discretization_factor,
         discretized_value.imag() * discretization_factor
     };
-}
\ No newline at end of file
+}
+bool EigenvaluePMF::write_to_file(const std::string& filename, uint64_t samples, const std::string& generator_description,
+                                  const std::string& metadata) const {
+    // The file stores bins in (imaginary, real) order. Flipping the sign bits
+    // makes the unsigned order of (imaginary, real) words the signed one.
+    std::vector<std::pair<uint64_t, uint64_t>> sorted_bins;
+    sorted_bins.reserve(bin_count());
+    for (int shard = 0; shard < SHARDS; ++shard) {
+        for_each_bin(shard, [&](const std::complex<int>& bin, uint64_t count) {
+            const uint64_t row = static_cast<uint32_t>(bin.imag()) ^ 0x80000000u;
+            const uint64_t column = static_cast<uint32_t>(bin.real()) ^ 0x80000000u;
+            sorted_bins.emplace_back(row << 32 | column, count);
+        });
+    }
+    std::sort(sorted_bins.begin(), sorted_bins.end());
+
+    HistogramHeader header;
+    header.kind = HistogramHeader::Kind::PMF;
+    header.bin_size = discretization_factor;
+    header.samples = samples;
+    header.generator = generator_description;
+    header.metadata = metadata;
+
+    HistogramWriter writer(filename, header);
+    if (!writer.is_open()) {
+        return false;
+    }
+    for (const auto& [bin, count] : sorted_bins) {
+        writer.append(static_cast<int32_t>(static_cast<uint32_t>(bin >> 32) ^ 0x80000000u),
+                      static_cast<int32_t>(static_cast<uint32_t>(bin) ^ 0x80000000u), count);
+    }
+    if (!writer.finish()) {
+        LOG_ERROR << "Error occurred while writing PMF to " << filename;
+        return false;
+    }
+    return true;
+}
+
+/// Loads a PMF histogram file, or an image histogram file binned at its pixel centers.
+EigenvaluePMF EigenvaluePMF::from_file(const std::string& filename) {
+    HistogramReader reader(filename);
+    const HistogramHeader& header = reader.header();
+    const bool image = header.kind == HistogramHeader::Kind::Image;
+    double pixel_width = image ? (header.real_max - header.real_min) / header.width : 0;
+    double pixel_height = image ? (header.imag_max - header.imag_min) / header.height : 0;
+
+    // Files don't carry a generator, only its description.
+    auto pmf = EigenvaluePMF(MatrixGenerator(0, nullptr), image ? std::min(pixel_width, pixel_height) : header.bin_size);
+    if (!reader.is_open()) {
+        return pmf;
+    }
+
+    int64_t row, column;
+    uint64_t count;
+    while (reader.next(row, column, count)) {
+        if (image) {
+            pmf.insert({header.real_min + (column + 0.5) * pixel_width,
+                        header.imag_min + (row + 0.5) * pixel_height}, count);
+        } else {
+            const uint64_t key = pack({static_cast<int>(column), static_cast<int>(row)});
+            pmf.shards[shard_of(BinTable::hash(key))].add(key, count);
+        }
+    }
+
+    pmf.get_max_count();
+    LOG_INFO << "Loaded " << pmf.bin_count() << " bins from " << filename;
+    return pmf;
+}
@@ -4,29 +4,60 @@
 #include <vector>
 #include <complex>
 #include <cinttypes>
+#include <string>
 
-#include <tbb/concurrent_unordered_map.h>
-
+#include "bin_table.h"
 #include "matrix_generator.h"
+#include "symmetry.h"
 
-namespace std {
-    template<>
-    struct hash<std::complex<int>> {
-        size_t operator()(const std::complex<int>& c) const {
-            return hash<int>()(c.real()) ^ hash<int>()(c.imag());
-        }
-    };
-}
+class LocalPMF;
+class Scheduler;
 
+// Eigenvalue counts binned on a square lattice of side bin_size() = 10^-precision,
+// independent of any viewport, so the same bins can be rendered into any
+// image later (see ImageHistogram::save_image() and load_from_file()).
+//
+// A bin is keyed by its discretized real and imaginary parts packed into 64
+// bits. The bins are split into SHARDS BinTables by the top bits of the key's
+// hash. Workers fill private LocalPMFs with the same sharding, and merge()
+// sums them shard by shard in parallel, so no two threads ever write the same
+// table.
 class EigenvaluePMF {
 public:
-    static EigenvaluePMF compute_pmf(const MatrixGenerator& generator, int num_samples, int precision=3);
+    static constexpr int SHARD_BITS = 6;
+    static constexpr int SHARDS = 1 << SHARD_BITS;
+
+    // An empty PMF with bins of side 10^-precision.
+    static EigenvaluePMF with_precision(int precision);
+    // Samples on `threads` threads (0 for every core).
+    static EigenvaluePMF compute_pmf(const MatrixGenerator& generator, uint64_t num_samples, int precision=3, int threads=0);
     static EigenvaluePMF from_file(const std::string& filename);
-    void insert(const std::complex<double>& eigenvalue);
-    static void compute_eigenvalues(int thread_id, int num_samples, MatrixGenerator thread_local_generator, std::atomic<int>& progress, EigenvaluePMF& pmf);
+    // Not thread-safe; concurrent writers go through LocalPMFs.
+    void insert(const std::complex<double>& eigenvalue, uint64_t count = 1);
+    // Adds the bins held by per-thread accumulators and clears them, one
+    // shard per task on `scheduler`.
+    void merge(std::vector<LocalPMF>& locals, Scheduler& scheduler);
+    // Replaces every bin by its orbit under `symmetry`, for PMFs sampled one
+    // orbit representative at a time. The images of a lattice point are
+    // lattice points, so this is exact.
+    void apply_symmetry(const SymmetryGroup& symmetry, Scheduler& scheduler);
+    // Writes the bins as a PMF histogram file (see histogram_file.h), with
+    // `metadata` in its header.
+    bool write_to_file(const std::string& filename, uint64_t samples, const std::string& generator,
+                       const std::string& metadata = std::string()) const;
+    static void compute_eigenvalues(int thread_id, uint64_t num_samples, MatrixGenerator thread_local_generator, std::atomic<uint64_t>& progress, LocalPMF& pmf);
     void get_max_count();
     uint64_t get_count(const std::complex<int>& discretized_eigenvalue) const;
-    size_t bin_count() const { return bins.size(); }
+    size_t bin_count() const;
+    double bin_size() const { return discretization_factor; }
+
+    // Calls f(discretized_eigenvalue, count) for every bin of one shard.
+    template<typename F>
+    void for_each_bin(int shard, F&& f) const {
+        shards[shard].for_each([&](uint64_t key, uint64_t count) {
+            f(unpack(key), count);
+        });
+    }
 
     // Delete default constructor, copy constructor, and assignment operator.
     EigenvaluePMF() = delete;
@@ -42,11 +73,42 @@ public:
     uint64_t max_count = 0;
     uint64_t total_eigenvalues = 0;
 
-    tbb::concurrent_unordered_map<std::complex<int>, std::atomic<uint64_t>> bins;
+    static uint64_t pack(const std::complex<int>& discretized_value) {
+        return static_cast<uint64_t>(static_cast<uint32_t>(discretized_value.real())) << 32 |
+               static_cast<uint32_t>(discretized_value.imag());
+    }
+    static std::complex<int> unpack(uint64_t key) {
+        return {static_cast<int32_t>(key >> 32), static_cast<int32_t>(key)};
+    }
+    static int shard_of(uint64_t hash) { return static_cast<int>(hash >> (64 - SHARD_BITS)); }
 
 private:
     MatrixGenerator generator;
     double discretization_factor = 0.001;
+    std::vector<BinTable> shards;
 
     EigenvaluePMF(const MatrixGenerator& generator, double discretization_factor);
-};
\ No newline at end of file
+};
+
+// Per-thread accumulator for an EigenvaluePMF. Hand the accumulators to
+// EigenvaluePMF::merge() to fold them in.
+class LocalPMF {
+public:
+    explicit LocalPMF(const EigenvaluePMF& pmf);
+    LocalPMF(LocalPMF&&) = default;
+
+    void insert(const std::complex<double>& eigenvalue, uint64_t count = 1) {
+        insert_bin(target->discretize(eigenvalue), count);
+    }
+    void insert_bin(const std::complex<int>& discretized_eigenvalue, uint64_t count) {
+        const uint64_t key = EigenvaluePMF::pack(discretized_eigenvalue);
+        const uint64_t hash = BinTable::hash(key);
+        shards[EigenvaluePMF::shard_of(hash)].add(key, hash, count);
+    }
+
+private:
+    const EigenvaluePMF* target;
+    std::vector<BinTable> shards;
+
+    friend class EigenvaluePMF;
+};
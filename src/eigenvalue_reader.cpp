@@ -0,0 +1,75 @@
+#include "eigenvalue_reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+EigenvalueReader::EigenvalueReader(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR << "Failed to open file for reading: " << filename;
+        return;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(size_t)) {
+        LOG_ERROR << "Eigenvalue file is too short: " << filename;
+        close(fd);
+        return;
+    }
+
+    void* address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        LOG_ERROR << "Failed to map " << filename;
+        return;
+    }
+    madvise(address, info.st_size, MADV_SEQUENTIAL);
+
+    size_t stored_count = *static_cast<const size_t*>(address);
+    size_t available = (info.st_size - sizeof(size_t)) / sizeof(std::complex<double>);
+    if (stored_count > available) {
+        LOG_ERROR << filename << " claims " << stored_count << " eigenvalues but holds " << available;
+        munmap(address, info.st_size);
+        return;
+    }
+
+    mapping = address;
+    mapping_size = info.st_size;
+    count = stored_count;
+    eigenvalues = reinterpret_cast<const std::complex<double>*>(static_cast<const char*>(address) + sizeof(size_t));
+}
+
+EigenvalueReader::~EigenvalueReader() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+void EigenvalueReader::advise(uint64_t begin, uint64_t end, int advice) const {
+    // madvise wants page-aligned ranges; round inward so neighbouring ranges
+    // still being read are not affected.
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t first = reinterpret_cast<uintptr_t>(eigenvalues + begin);
+    uintptr_t last = reinterpret_cast<uintptr_t>(eigenvalues + end);
+    if (advice == MADV_WILLNEED) {
+        first &= ~(page - 1);
+    } else {
+        first = (first + page - 1) & ~(page - 1);
+        last &= ~(page - 1);
+    }
+    if (last > first) {
+        madvise(reinterpret_cast<void*>(first), last - first, advice);
+    }
+}
+
+void EigenvalueReader::prefetch(uint64_t begin, uint64_t end) const {
+    advise(begin, end, MADV_WILLNEED);
+}
+
+void EigenvalueReader::release(uint64_t begin, uint64_t end) const {
+    advise(begin, end, MADV_DONTNEED);
+}
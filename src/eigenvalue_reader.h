@@ -0,0 +1,38 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a raw eigenvalue dump (the layout written by
+// EigenvalueWriter: a size_t count followed by the eigenvalues).
+//
+// Nothing is read up front; pages are faulted in as they are touched and can
+// be dropped again with release(), so scanning a file of any size only costs
+// the pages currently being binned.
+class EigenvalueReader {
+public:
+    explicit EigenvalueReader(const std::string& filename);
+    ~EigenvalueReader();
+
+    EigenvalueReader(const EigenvalueReader&) = delete;
+    EigenvalueReader& operator=(const EigenvalueReader&) = delete;
+
+    bool is_open() const { return mapping != nullptr; }
+    uint64_t size() const { return count; }
+    const std::complex<double>* data() const { return eigenvalues; }
+
+    // Hint that [begin, end) is about to be read.
+    void prefetch(uint64_t begin, uint64_t end) const;
+    // Drop the pages holding [begin, end) once they have been consumed.
+    void release(uint64_t begin, uint64_t end) const;
+
+private:
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    uint64_t count = 0;
+    const std::complex<double>* eigenvalues = nullptr;
+
+    void advise(uint64_t begin, uint64_t end, int advice) const;
+};
@@ -0,0 +1,76 @@
+#include "eigenvalue_writer.h"
+
+#include <algorithm>
+
+#include "logger.h"
+
+EigenvalueWriter::EigenvalueWriter(const std::string& filename, size_t pool_chunks, size_t chunk_size)
+    : file(filename, std::ios::binary), chunk_capacity(chunk_size), pool(std::max<size_t>(pool_chunks, 1)) {
+    if (!file.is_open()) {
+        LOG_ERROR << "Failed to open file for writing: " << filename;
+        return;
+    }
+
+    // Placeholder count, patched by finish().
+    size_t size = 0;
+    file.write(reinterpret_cast<const char*>(&size), sizeof(size_t));
+
+    full_chunks.set_capacity(pool.size() + 1);
+    for (auto& chunk : pool) {
+        chunk.reserve(chunk_capacity);
+        free_chunks.push(&chunk);
+    }
+    writer = std::thread(&EigenvalueWriter::write_loop, this);
+}
+
+EigenvalueWriter::~EigenvalueWriter() {
+    if (file.is_open() && !finished) {
+        finish();
+    }
+}
+
+EigenvalueWriter::Chunk* EigenvalueWriter::acquire() {
+    Chunk* chunk = nullptr;
+    free_chunks.pop(chunk);
+    return chunk;
+}
+
+void EigenvalueWriter::submit(Chunk* chunk) {
+    full_chunks.push(chunk);
+}
+
+void EigenvalueWriter::write_loop() {
+    Chunk* chunk = nullptr;
+    while (true) {
+        full_chunks.pop(chunk);
+        if (chunk == nullptr) {
+            break;
+        }
+        if (!failed) {
+            file.write(reinterpret_cast<const char*>(chunk->data()), chunk->size() * sizeof(std::complex<double>));
+            if (file.good()) {
+                count += chunk->size();
+            } else {
+                LOG_ERROR << "Error occurred while writing eigenvalues after " << count << " values";
+                failed = true;
+            }
+        }
+        chunk->clear();
+        free_chunks.push(chunk);
+    }
+}
+
+bool EigenvalueWriter::finish() {
+    if (!file.is_open() || finished) {
+        return false;
+    }
+    finished = true;
+    full_chunks.push(nullptr);
+    writer.join();
+
+    size_t size = count;
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&size), sizeof(size_t));
+    file.close();
+    return !failed && !file.fail();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <tbb/concurrent_queue.h>
+
+// Streams raw eigenvalues to disk from many producer threads.
+//
+// Producers fill fixed-size chunks taken from a preallocated pool and hand
+// them to a single writer thread through a bounded queue; the writer appends
+// each chunk with one sequential write and returns it to the pool. When the
+// pool runs dry producers block until the disk catches up, so memory use is
+// pool_chunks * chunk_size eigenvalues no matter how many are written.
+//
+// The file layout is the one EigenvalueReader reads: a size_t count,
+// patched in by finish(), followed by the eigenvalues.
+class EigenvalueWriter {
+public:
+    using Chunk = std::vector<std::complex<double>>;
+
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 16;  // 1 MB of eigenvalues
+
+    EigenvalueWriter(const std::string& filename, size_t pool_chunks, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+    ~EigenvalueWriter();
+
+    bool is_open() const { return file.is_open(); }
+    size_t chunk_size() const { return chunk_capacity; }
+
+    // Takes an empty chunk from the pool, waiting for one if all are in flight.
+    Chunk* acquire();
+    // Queues a chunk for writing. Partially filled chunks are fine.
+    void submit(Chunk* chunk);
+
+    // Writes everything still queued, patches the count and closes the file.
+    // Returns false if any write failed.
+    bool finish();
+    uint64_t written() const { return count; }
+
+private:
+    std::ofstream file;
+    size_t chunk_capacity;
+    std::vector<Chunk> pool;
+    tbb::concurrent_bounded_queue<Chunk*> free_chunks;
+    tbb::concurrent_bounded_queue<Chunk*> full_chunks;  // nullptr stops the writer
+    std::thread writer;
+    uint64_t count = 0;
+    bool failed = false;
+    bool finished = false;
+
+    void write_loop();
+};
@@ -0,0 +1,245 @@
+#include "enumerator.h"
+
+#include <cmath>
+#include <limits>
+
+#include "eigen_solver.h"
+#include "logger.h"
+
+namespace {
+
+// Collapse a list of values into distinct values with multiplicities.
+void add_weighted(std::vector<std::complex<double>>& values, std::vector<uint64_t>& weights,
+                  const std::complex<double>& value) {
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (values[i] == value) {
+            weights[i]++;
+            return;
+        }
+    }
+    values.push_back(value);
+    weights.push_back(1);
+}
+
+// The roots of a real polynomial come in conjugate pairs, but the root finder
+// leaves its real roots a rounding error off the axis. A root whose conjugate
+// is nearer to itself than to any other root has no partner and is real: it
+// gets an imaginary part of exactly 0, as LAPACK would give it, which keeps
+// ignore_reals and bins on the real axis working.
+void snap_real_roots(std::complex<double>* roots, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (roots[i].imag() == 0) {
+            continue;
+        }
+        const std::complex<double> mirror = std::conj(roots[i]);
+        const double own = std::abs(mirror - roots[i]);
+        bool paired = false;
+        for (int j = 0; j < n && !paired; ++j) {
+            paired = j != i && std::abs(mirror - roots[j]) < own;
+        }
+        if (!paired) {
+            roots[i].imag(0);
+        }
+    }
+}
+
+} // namespace
+
+TridiagonalEnumerator::TridiagonalEnumerator(int n, const std::vector<std::complex<double>>& values,
+                                             int prefix_depth, uint64_t min_units)
+    : n(n), prefix_depth(prefix_depth) {
+    for (const auto& a : values) {
+        add_weighted(diagonal, diagonal_weights, a);
+    }
+    for (const auto& b : values) {
+        for (const auto& c : values) {
+            add_weighted(products, product_weights, b * c);
+        }
+    }
+
+    if (this->prefix_depth <= 0) {
+        this->prefix_depth = 1;
+        while (this->prefix_depth < n && units_for_depth(this->prefix_depth) < min_units) {
+            this->prefix_depth++;
+        }
+    }
+    if (this->prefix_depth > n) {
+        this->prefix_depth = n;
+    }
+    // Unit numbers are 64-bit.
+    if (units_for_depth(this->prefix_depth) == std::numeric_limits<uint64_t>::max()) {
+        while (this->prefix_depth > 1 && units_for_depth(this->prefix_depth) == std::numeric_limits<uint64_t>::max()) {
+            this->prefix_depth--;
+        }
+        LOG_ERROR << "prefix_depth " << prefix_depth << " gives more than 2^64 work units; using "
+                  << this->prefix_depth;
+    }
+    units = units_for_depth(this->prefix_depth);
+
+    LOG_DEBUG << "Enumerating " << diagonal.size() << " diagonal values and "
+              << products.size() << " off-diagonal products";
+}
+
+uint64_t TridiagonalEnumerator::choices(int level) const {
+    return level == 0 ? diagonal.size() : diagonal.size() * products.size();
+}
+
+/// Saturates at the largest uint64_t instead of wrapping.
+uint64_t TridiagonalEnumerator::units_for_depth(int depth) const {
+    uint64_t count = 1;
+    for (int level = 0; level < depth; ++level) {
+        if (__builtin_mul_overflow(count, choices(level), &count)) {
+            return std::numeric_limits<uint64_t>::max();
+        }
+    }
+    return count;
+}
+
+double TridiagonalEnumerator::leaf_count() const {
+    double count = 1;
+    for (int level = 0; level < n; ++level) {
+        count *= static_cast<double>(choices(level));
+    }
+    return count;
+}
+
+double TridiagonalEnumerator::matrix_count() const {
+    double values = static_cast<double>(diagonal.size());
+    return std::pow(values, n) * std::pow(values * values, n - 1);
+}
+
+/// Saturates like units_for_depth(); every leaf weight is a product of the
+/// same factors, so no partial sum of weights can overflow if this does not.
+uint64_t TridiagonalEnumerator::exact_matrix_count() const {
+    uint64_t diagonal_total = 0, product_total = 0;
+    for (uint64_t weight : diagonal_weights) diagonal_total += weight;
+    for (uint64_t weight : product_weights) product_total += weight;
+    uint64_t count = 1;
+    for (int level = 0; level < n; ++level) {
+        const uint64_t factor = level == 0 ? diagonal_total : diagonal_total * product_total;
+        if (__builtin_mul_overflow(count, factor, &count)) {
+            return std::numeric_limits<uint64_t>::max();
+        }
+    }
+    return count;
+}
+
+void TridiagonalEnumerator::enumerate_unit(uint64_t unit, const LeafCallback& visit) const {
+    // Row k of `minors` holds the coefficients of p_k, lowest degree first.
+    // Choosing level k extends the recurrence by one step from rows k and
+    // k - 1, so every prefix's minors are computed once and shared by all the
+    // leaves below it, and a leaf costs O(n) on top of its parent.
+    // sequence holds the choices as indices a_0, d_0, a_1, ..., a_{n-1}.
+    std::vector<std::complex<double>> minors((n + 1) * (n + 1), 0);
+    minors[0] = 1;
+    std::vector<uint32_t> sequence(2 * n - 1);
+
+    // Leaves are solved a batch at a time by the Aberth root finder on
+    // det(xI - A) = (-1)^n p_n(x), in companion storage (the negated
+    // coefficients of the monic polynomial).
+    EigenSolver solver(n, MatrixStructure::Companion);
+    solver.use_aberth();
+    const int batch_size = EigenSolver::DEFAULT_BATCH_SIZE;
+    std::vector<std::complex<double>> batch(batch_size * n), eigenvalues(batch_size * n);
+    std::vector<uint64_t> batch_weights(batch_size);
+    std::vector<char> batch_real(batch_size);
+    int batched = 0;
+
+    auto solve_batch = [&]() {
+        solver.solve_batch(batch.data(), batched, eigenvalues.data());
+        for (int m = 0; m < batched; ++m) {
+            if (batch_real[m]) {
+                snap_real_roots(eigenvalues.data() + m * n, n);
+            }
+            visit(eigenvalues.data() + m * n, batch_weights[m]);
+        }
+        batched = 0;
+    };
+
+    auto extend = [&](int level, uint64_t choice) {
+        const uint64_t a = level == 0 ? choice : choice / products.size();
+        sequence[2 * level] = static_cast<uint32_t>(a);
+        const std::complex<double>* previous = &minors[level * (n + 1)];
+        std::complex<double>* next = &minors[(level + 1) * (n + 1)];
+        // p_{k+1} = (a_k - x) p_k - d_{k-1} p_{k-1}
+        next[level + 1] = 0;
+        for (int j = 0; j <= level; ++j) {
+            next[j] = diagonal[a] * previous[j];
+        }
+        for (int j = 0; j <= level; ++j) {
+            next[j + 1] -= previous[j];
+        }
+        if (level > 0) {
+            const uint64_t d = choice % products.size();
+            sequence[2 * level - 1] = static_cast<uint32_t>(d);
+            const std::complex<double>* before = &minors[(level - 1) * (n + 1)];
+            for (int j = 0; j < level; ++j) {
+                next[j] -= products[d] * before[j];
+            }
+        }
+    };
+
+    auto weight_of = [&](int level, uint64_t choice) -> uint64_t {
+        if (level == 0) return diagonal_weights[choice];
+        return diagonal_weights[choice / products.size()] * product_weights[choice % products.size()];
+    };
+
+    // Reversing the index order is a similarity (and keeps the weight), so a
+    // leaf and its reversal share a spectrum: solve the smaller of the two
+    // for both, and palindromes once.
+    auto solve_leaf = [&](uint64_t weight) {
+        const int last = 2 * n - 2;
+        int i = 0;
+        while (i < last - i && sequence[i] == sequence[last - i]) {
+            i++;
+        }
+        if (i < last - i) {
+            if (sequence[i] > sequence[last - i]) {
+                return;
+            }
+            weight *= 2;
+        }
+        const std::complex<double>* p = &minors[n * (n + 1)];
+        const double sign = n % 2 == 0 ? -1.0 : 1.0;  // -(-1)^n
+        bool real = true;
+        for (int k = 0; k < n; ++k) {
+            batch[batched * n + k] = sign * p[k];
+            real &= p[k].imag() == 0;
+        }
+        batch_weights[batched] = weight;
+        batch_real[batched] = real;
+        if (++batched == batch_size) {
+            solve_batch();
+        }
+    };
+
+    std::function<void(int, uint64_t)> walk = [&](int level, uint64_t weight) {
+        if (level == n) {
+            solve_leaf(weight);
+            return;
+        }
+        const uint64_t count = choices(level);
+        for (uint64_t choice = 0; choice < count; ++choice) {
+            extend(level, choice);
+            walk(level + 1, weight * weight_of(level, choice));
+        }
+    };
+
+    // Decode the unit into the prefix choices, most significant level first.
+    std::vector<uint64_t> prefix(prefix_depth);
+    uint64_t rest = unit;
+    for (int level = prefix_depth - 1; level >= 0; --level) {
+        prefix[level] = rest % choices(level);
+        rest /= choices(level);
+    }
+
+    uint64_t weight = 1;
+    for (int level = 0; level < prefix_depth; ++level) {
+        extend(level, prefix[level]);
+        weight *= weight_of(level, prefix[level]);
+    }
+    walk(prefix_depth, weight);
+    if (batched > 0) {
+        solve_batch();
+    }
+}
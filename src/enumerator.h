@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <functional>
+
+// Walks every n x n tridiagonal matrix whose entries come from a value set.
+//
+// The characteristic polynomial of a tridiagonal matrix only depends on the
+// diagonal a_k and on the products d_k = b_k * c_k of opposite off-diagonal
+// entries, through the leading principal minor recurrence
+//     p_k(x) = (a_k - x) p_{k-1}(x) - d_{k-1} p_{k-2}(x).
+// The enumerator therefore walks (diagonal, product) choices instead of raw
+// entries, weighting each leaf by how many (b, c) pairs give its products.
+//
+// The walk extends this recurrence one level at a time: each prefix carries
+// the coefficients of its minors p_k, computed once from its parent's and
+// shared by every leaf below it, so a leaf costs one O(n) step on top of its
+// parent. The roots of p_n are found in batches by the Aberth root finder
+// (EigenSolver's companion path, which falls back to LAPACK for leaves it
+// cannot converge on), and a leaf and its reversal, which are similar, are
+// solved once for both.
+//
+// Matrix counts are weights summed into 64-bit sample counts, so sizes whose
+// matrix_count() does not fit in a uint64_t (n = 8 and up for the 9-value
+// set) are beyond enumeration; exact_matrix_count() tells them apart.
+//
+// The space is split into work units, one per choice of the first
+// prefix_depth levels. Units are independent and numbered, so a job can be
+// spread over threads or resumed from any unit.
+class TridiagonalEnumerator {
+public:
+    // Called once per leaf with the n eigenvalues and the number of matrices
+    // that share them.
+    using LeafCallback = std::function<void(const std::complex<double>* eigenvalues, uint64_t weight)>;
+
+    // A prefix_depth of 0 picks one that gives at least min_units work units.
+    TridiagonalEnumerator(int n, const std::vector<std::complex<double>>& values, int prefix_depth = 0, uint64_t min_units = 1024);
+
+    int size() const { return n; }
+    int get_prefix_depth() const { return prefix_depth; }
+    uint64_t unit_count() const { return units; }
+    // Number of distinct (diagonal, product) leaves, and of matrices they stand for.
+    double leaf_count() const;
+    double matrix_count() const;
+    // matrix_count() exactly, or the largest uint64_t if it does not fit.
+    uint64_t exact_matrix_count() const;
+
+    void enumerate_unit(uint64_t unit, const LeafCallback& visit) const;
+
+private:
+    int n;
+    int prefix_depth;
+    uint64_t units;
+    std::vector<std::complex<double>> diagonal;  // Distinct diagonal values
+    std::vector<uint64_t> diagonal_weights;      // Multiplicity of each diagonal value
+    std::vector<std::complex<double>> products;  // Distinct off-diagonal products
+    std::vector<uint64_t> product_weights;       // Number of (b, c) pairs giving each product
+
+    // Number of choices at a level (0-based): a_0 alone, then (a_k, d_{k-1}) pairs.
+    uint64_t choices(int level) const;
+    // Saturates at the largest uint64_t; the constructor keeps below it.
+    uint64_t units_for_depth(int depth) const;
+};
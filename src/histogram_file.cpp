@@ -0,0 +1,317 @@
+#include "histogram_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <tuple>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+namespace {
+
+constexpr char MAGIC[4] = {'B', 'H', 'S', 'T'};
+constexpr uint32_t VERSION = 2;  // 2 added the metadata block
+constexpr size_t BUFFER_SIZE = 1 << 20;
+
+uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+template<typename T>
+void write_field(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool read_field(std::ifstream& file, T& value) {
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+bool sync_file(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+} // namespace
+
+bool HistogramHeader::compatible_with(const HistogramHeader& other) const {
+    return kind == other.kind && width == other.width && height == other.height &&
+           real_min == other.real_min && real_max == other.real_max &&
+           imag_min == other.imag_min && imag_max == other.imag_max &&
+           bin_size == other.bin_size && generator == other.generator;
+}
+
+HistogramWriter::HistogramWriter(const std::string& filename, const HistogramHeader& header)
+    : filename(filename), temporary(filename + ".tmp"), file(temporary, std::ios::binary) {
+    if (!file.is_open()) {
+        LOG_ERROR << "Failed to open file for writing: " << temporary;
+        return;
+    }
+
+    file.write(MAGIC, sizeof(MAGIC));
+    write_field(file, VERSION);
+    write_field(file, static_cast<uint32_t>(header.kind));
+    write_field(file, header.resolution);
+    write_field(file, header.width);
+    write_field(file, header.height);
+    write_field(file, header.real_min);
+    write_field(file, header.real_max);
+    write_field(file, header.imag_min);
+    write_field(file, header.imag_max);
+    write_field(file, header.bin_size);
+    write_field(file, header.samples);
+    entries_offset = file.tellp();
+    write_field(file, uint64_t(0));
+    write_field(file, static_cast<uint32_t>(header.generator.size()));
+    file.write(header.generator.data(), header.generator.size());
+    write_field(file, static_cast<uint32_t>(header.metadata.size()));
+    file.write(header.metadata.data(), header.metadata.size());
+
+    buffer.reserve(BUFFER_SIZE);
+}
+
+HistogramWriter::~HistogramWriter() {
+    if (file.is_open()) {
+        discard();
+    }
+}
+
+void HistogramWriter::put_varint(uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+void HistogramWriter::flush_buffer() {
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    buffer.clear();
+}
+
+void HistogramWriter::append(int64_t row, int64_t column, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+    put_varint(zigzag(row - last_row));
+    if (entries > 0 && row == last_row) {
+        put_varint(static_cast<uint64_t>(column - last_column - 1));
+    } else {
+        put_varint(zigzag(column));
+    }
+    put_varint(count);
+    last_row = row;
+    last_column = column;
+    entries++;
+
+    if (buffer.size() + 32 > BUFFER_SIZE) {
+        flush_buffer();
+    }
+}
+
+bool HistogramWriter::finish() {
+    flush_buffer();
+    file.seekp(entries_offset);
+    write_field(file, entries);
+    bool ok = file.good();
+    file.close();
+    if (!ok || !sync_file(temporary)) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        LOG_ERROR << "Failed to move histogram into place: " << filename;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+void HistogramWriter::discard() {
+    file.close();
+    std::remove(temporary.c_str());
+}
+
+HistogramReader::HistogramReader(const std::string& filename)
+    : file(filename, std::ios::binary) {
+    if (!file.is_open()) {
+        LOG_ERROR << "Failed to open file for reading: " << filename;
+        return;
+    }
+
+    char magic[4];
+    uint32_t version = 0, kind = 0, generator_length = 0, metadata_length = 0;
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        LOG_ERROR << filename << " is not a histogram file";
+        return;
+    }
+    read_field(file, version);
+    if (version == 0 || version > VERSION) {
+        LOG_ERROR << "Unsupported histogram file version " << version << " in " << filename;
+        return;
+    }
+    read_field(file, kind);
+    header_.kind = static_cast<HistogramHeader::Kind>(kind);
+    read_field(file, header_.resolution);
+    read_field(file, header_.width);
+    read_field(file, header_.height);
+    read_field(file, header_.real_min);
+    read_field(file, header_.real_max);
+    read_field(file, header_.imag_min);
+    read_field(file, header_.imag_max);
+    read_field(file, header_.bin_size);
+    read_field(file, header_.samples);
+    read_field(file, header_.entries);
+    read_field(file, generator_length);
+    header_.generator.resize(generator_length);
+    file.read(&header_.generator[0], generator_length);
+    if (version >= 2) {
+        read_field(file, metadata_length);
+        header_.metadata.resize(metadata_length);
+        file.read(&header_.metadata[0], metadata_length);
+    }
+
+    if (!file.good()) {
+        LOG_ERROR << "Truncated histogram header in " << filename;
+        return;
+    }
+    remaining = header_.entries;
+    buffer.resize(BUFFER_SIZE);
+    valid = true;
+}
+
+bool HistogramReader::refill() {
+    file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+    filled = static_cast<size_t>(file.gcount());
+    position = 0;
+    return filled > 0;
+}
+
+bool HistogramReader::get_varint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (position == filled && !refill()) {
+            return false;
+        }
+        uint8_t byte = buffer[position++];
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HistogramReader::next(int64_t& row, int64_t& column, uint64_t& count) {
+    if (!valid || remaining == 0) {
+        return false;
+    }
+    uint64_t row_step, column_code;
+    if (!get_varint(row_step) || !get_varint(column_code) || !get_varint(count)) {
+        LOG_ERROR << "Histogram file ended after " << header_.entries - remaining << " of " << header_.entries << " entries";
+        valid = false;
+        return false;
+    }
+    const bool first = remaining == header_.entries;
+    row = last_row + unzigzag(row_step);
+    if (!first && row == last_row) {
+        column = last_column + static_cast<int64_t>(column_code) + 1;
+    } else {
+        column = unzigzag(column_code);
+    }
+    last_row = row;
+    last_column = column;
+    remaining--;
+    return true;
+}
+
+bool is_histogram_file(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    char magic[4];
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool merge_histogram_files(const std::vector<std::string>& inputs, const std::string& output) {
+    if (inputs.empty()) {
+        LOG_ERROR << "No histogram files to merge";
+        return false;
+    }
+
+    std::vector<std::unique_ptr<HistogramReader>> readers;
+    HistogramHeader header;
+    for (const auto& input : inputs) {
+        readers.push_back(std::make_unique<HistogramReader>(input));
+        if (!readers.back()->is_open()) {
+            return false;
+        }
+        if (readers.back()->header().kind == HistogramHeader::Kind::Snapshot) {
+            LOG_ERROR << input << " is a checkpoint snapshot and cannot be merged";
+            return false;
+        }
+        if (readers.size() == 1) {
+            header = readers.back()->header();
+            header.samples = 0;
+            header.metadata.clear();
+        } else if (!header.compatible_with(readers.back()->header())) {
+            LOG_ERROR << "Histogram header of " << input << " does not match " << inputs.front();
+            return false;
+        }
+        header.samples += readers.back()->header().samples;
+    }
+
+    // k-way merge of the sorted entry streams.
+    using Entry = std::tuple<int64_t, int64_t, uint64_t, size_t>;  // row, column, count, reader
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heads;
+    auto advance = [&](size_t i) {
+        int64_t row, column;
+        uint64_t count;
+        if (readers[i]->next(row, column, count)) {
+            heads.emplace(row, column, count, i);
+        }
+    };
+    for (size_t i = 0; i < readers.size(); ++i) {
+        advance(i);
+    }
+
+    HistogramWriter writer(output, header);
+    if (!writer.is_open()) {
+        return false;
+    }
+    while (!heads.empty()) {
+        auto [row, column, count, i] = heads.top();
+        heads.pop();
+        advance(i);
+        while (!heads.empty() && std::get<0>(heads.top()) == row && std::get<1>(heads.top()) == column) {
+            count += std::get<2>(heads.top());
+            size_t j = std::get<3>(heads.top());
+            heads.pop();
+            advance(j);
+        }
+        writer.append(row, column, count);
+    }
+
+    for (size_t i = 0; i < readers.size(); ++i) {
+        if (!readers[i]->is_open()) {
+            LOG_ERROR << "Failed to read " << inputs[i] << " while merging";
+            writer.discard();
+            return false;
+        }
+    }
+    if (!writer.finish()) {
+        LOG_ERROR << "Failed to write " << output;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Binary histogram file, replacing raw eigenvalue dumps.
+//
+// A little-endian header describes how the counts were binned, followed
+// by one entry per nonzero bin in (row, column) order. Entries are varints: the
+// zigzag-encoded row step, then either the gap since the previous column (same
+// row) or the zigzag-encoded column (new row), then the count. Runs of empty
+// bins cost nothing, and typical bins take three to four bytes.
+//
+// Image histograms use (pixel row, pixel column) as the bin; EigenvaluePMF uses
+// the discretized (imaginary, real) parts. Files with matching headers can be
+// merged by summing their counts.
+struct HistogramHeader {
+    enum class Kind : uint32_t {
+        Image = 1,     // Pixel grid of an ImageHistogram
+        PMF = 2,       // Sparse bins of an EigenvaluePMF
+        Snapshot = 3   // Unfolded ImageHistogram state for checkpoints (see ImageHistogram::write_snapshot)
+    };
+
+    Kind kind = Kind::Image;
+    int32_t resolution = 0;
+    int32_t width = 0, height = 0;
+    double real_min = 0, real_max = 0, imag_min = 0, imag_max = 0;
+    double bin_size = 0;        // PMF bin width (10^-precision)
+    uint64_t samples = 0;       // Matrices the counts stand for
+    uint64_t entries = 0;       // Nonzero bins in the body
+    std::string generator;      // Description of the matrix generator
+    std::string metadata;       // Opaque bytes for the producer, e.g. checkpoint run state
+
+    // True if the two files bin the same way and can be summed.
+    bool compatible_with(const HistogramHeader& other) const;
+};
+
+// Writes a histogram file to `filename` + ".tmp" and only moves it into place
+// once it is complete and synced to disk, so a killed or failing writer never
+// leaves a truncated file under `filename` for load or merge to pick up.
+class HistogramWriter {
+public:
+    // Writes the header; entries is patched in by finish().
+    HistogramWriter(const std::string& filename, const HistogramHeader& header);
+    // Discards the file unless finish() was called.
+    ~HistogramWriter();
+
+    bool is_open() const { return file.is_open(); }
+    // Entries must come in increasing (row, column) order.
+    void append(int64_t row, int64_t column, uint64_t count);
+    // Flushes, patches the entry count into the header, closes, syncs and
+    // renames the file into place. Returns false on an I/O error, leaving
+    // `filename` as it was.
+    bool finish();
+    // Closes without finishing and deletes the partial file.
+    void discard();
+
+private:
+    std::string filename;
+    std::string temporary;
+    std::ofstream file;
+    std::vector<uint8_t> buffer;
+    uint64_t entries = 0;
+    int64_t last_row = 0, last_column = 0;
+    std::streampos entries_offset;
+
+    void put_varint(uint64_t value);
+    void flush_buffer();
+};
+
+class HistogramReader {
+public:
+    explicit HistogramReader(const std::string& filename);
+
+    // False if the file could not be opened or is not a histogram file.
+    bool is_open() const { return valid; }
+    const HistogramHeader& header() const { return header_; }
+    // Reads the next entry; returns false after the last one or on a corrupt file.
+    bool next(int64_t& row, int64_t& column, uint64_t& count);
+
+private:
+    std::ifstream file;
+    HistogramHeader header_;
+    bool valid = false;
+    std::vector<uint8_t> buffer;
+    size_t position = 0, filled = 0;
+    uint64_t remaining = 0;
+    int64_t last_row = 0, last_column = 0;
+
+    bool get_varint(uint64_t& value);
+    bool refill();
+};
+
+// True if the file starts with the histogram file magic.
+bool is_histogram_file(const std::string& filename);
+
+// Sums histogram files with compatible headers into `output`, streaming through
+// the inputs so memory use does not depend on their size. Like every
+// HistogramWriter file, `output` is never left half written.
+bool merge_histogram_files(const std::vector<std::string>& inputs, const std::string& output);
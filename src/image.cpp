@@ -1,19 +1,20 @@
 #include "image.h"
 #include <cstring>
-#include <thread>
 #include <numeric>
 #include <algorithm>
 #include <cmath>
 #include <filesystem> // Added for std::filesystem::create_directories
+#include <mutex>
+#include <condition_variable>
 
 #include "tinycolormap.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
 
 #include "logger.h"
+#include "png_writer.h"
 
-ImageHistogram::ImageHistogram(int resolution, double rmin, double rmax, double imin, double imax)
-    : real_min(rmin), real_max(rmax), imag_min(imin), imag_max(imax) {
+ImageHistogram::ImageHistogram(int resolution, double rmin, double rmax, double imin, double imax,
+                               const std::string& spill_file)
+    : resolution(resolution), real_min(rmin), real_max(rmax), imag_min(imin), imag_max(imax) {
     double real_range = real_max - real_min;
     double imag_range = imag_max - imag_min;
     double aspect_ratio = real_range / imag_range;
@@ -25,123 +26,480 @@ ImageHistogram::ImageHistogram(int resolution, double rmin, double rmax, double
         height = static_cast<int>(resolution / aspect_ratio);
     }
 
-    histogram = new std::atomic<uint64_t>[width * height];
-    for (int i = 0; i < width * height; ++i) {
-        histogram[i].store(0, std::memory_order_relaxed);
+    histogram = std::make_unique<TileStore>(width, height, spill_file);
+}
+
+void ImageHistogram::set_scheduler(Scheduler& scheduler) {
+    this->scheduler = &scheduler;
+}
+
+Scheduler& ImageHistogram::workers() {
+    if (!scheduler) {
+        own_scheduler = std::make_unique<Scheduler>();
+        scheduler = own_scheduler.get();
+    }
+    return *scheduler;
+}
+
+void ImageHistogram::add_point(const std::complex<double>& point, uint64_t count) {
+    if (!may_contain(point)) {
+        return;
+    }
+    size_t pixels[8];
+    int found = locate(point, count, pixels);
+    for (int i = 0; i < found; ++i) {
+        histogram->add(pixels[i], count);
+    }
+}
+
+int ImageHistogram::locate(const std::complex<double>& point, uint64_t count, size_t* pixels) {
+    if (mirror_on_render) {
+        return locate_mirrored(point, count, pixels);
+    }
+    if (symmetry.is_trivial()) {
+        return locate_pixel(point, pixels);
+    }
+    std::complex<double> images[8];
+    symmetry.orbit(point, images);
+    int found = 0;
+    for (int i = 0; i < symmetry.order(); ++i) {
+        found += locate_pixel(images[i], pixels + found);
     }
+    return found;
 }
 
-void ImageHistogram::add_point(const std::complex<double>& point) {
+int ImageHistogram::locate_pixel(const std::complex<double>& point, size_t* pixel) const {
     int x = static_cast<int>((point.real() - real_min) / (real_max - real_min) * width);
     int y = static_cast<int>((point.imag() - imag_min) / (imag_max - imag_min) * height);
     
     if (x >= 0 && x < width && y >= 0 && y < height) {
-        histogram[y * width + x].fetch_add(1, std::memory_order_relaxed);
+        *pixel = histogram->index(x, y);
+        return 1;
+    }
+    return 0;
+}
+
+void ImageHistogram::set_symmetry(const SymmetryGroup& group) {
+    symmetry = group;
+    mirror_on_render = !symmetry.is_trivial() && viewport_has_symmetry(symmetry);
+    orbit_filter = !symmetry.is_trivial() && !mirror_on_render;
+    if (orbit_filter) {
+        // Squared distances from the origin of the nearest point and farthest
+        // corner of the viewport, padded against rounding.
+        const double near_real = std::clamp(0.0, real_min, real_max);
+        const double near_imag = std::clamp(0.0, imag_min, imag_max);
+        const double far_real = std::max(std::abs(real_min), std::abs(real_max));
+        const double far_imag = std::max(std::abs(imag_min), std::abs(imag_max));
+        orbit_norm_min = (near_real * near_real + near_imag * near_imag) * (1 - 1e-9);
+        orbit_norm_max = (far_real * far_real + far_imag * far_imag) * (1 + 1e-9);
+    }
+    if (mirror_on_render) {
+        axis_column = std::make_unique<std::atomic<uint64_t>[]>(height);
+        axis_row = std::make_unique<std::atomic<uint64_t>[]>(width);
+        for (int i = 0; i < height; ++i) axis_column[i].store(0, std::memory_order_relaxed);
+        for (int i = 0; i < width; ++i) axis_row[i].store(0, std::memory_order_relaxed);
+        axis_origin.store(0, std::memory_order_relaxed);
+    }
+    if (!symmetry.is_trivial()) {
+        LOG_INFO << "Histogram symmetry: " << symmetry.describe() << ", "
+                 << (mirror_on_render ? "mirrored on render" : "binned per orbit (viewport is not symmetric)");
+    }
+}
+
+bool ImageHistogram::viewport_has_symmetry(const SymmetryGroup& group) const {
+    const double tolerance = 1e-9 * std::max(real_max - real_min, imag_max - imag_min);
+    bool real_symmetric = std::abs(real_min + real_max) <= tolerance;
+    bool imag_symmetric = std::abs(imag_min + imag_max) <= tolerance;
+    if (group.has_conjugation() && !imag_symmetric) {
+        return false;
+    }
+    if (group.rotation_step() < 4 && !(real_symmetric && imag_symmetric)) {
+        return false;
+    }
+    if (group.rotation_step() == 1) {
+        // Quarter turns swap the axes, so pixels must map onto pixels.
+        return width == height && std::abs((real_max - real_min) - (imag_max - imag_min)) <= tolerance;
+    }
+    return true;
+}
+
+// Plain truncation puts a point on a pixel edge into the pixel above it, which is
+// not symmetric about the center: an exact eigenvalue such as -1 and its mirror
+// image 1 would land one pixel apart after reflecting. Edge points go to the pixel
+// farther from the center instead. The center line itself of an even-sized axis
+// has no symmetric choice; callers handle it separately.
+static int mirrored_coordinate(double offset, int extent) {
+    const double nearest = std::round(offset);
+    if (std::abs(offset - nearest) < 1e-7) {
+        int edge = static_cast<int>(nearest);
+        return 2 * edge < extent ? edge - 1 : edge;
     }
+    return static_cast<int>(std::floor(offset));
 }
 
-uint64_t ImageHistogram::parallel_max() const {
-    const int num_threads = std::thread::hardware_concurrency();
-    const int chunk_size = (width * height + num_threads - 1) / num_threads;
+int ImageHistogram::locate_mirrored(const std::complex<double>& point, uint64_t count, size_t* pixel) {
+    double u = (point.real() - real_min) / (real_max - real_min) * width;
+    double v = (point.imag() - imag_min) / (imag_max - imag_min) * height;
+    bool on_vertical_axis = width % 2 == 0 && std::abs(u - width / 2) < 1e-7;
+    bool on_horizontal_axis = height % 2 == 0 && std::abs(v - height / 2) < 1e-7;
+
+    if (!on_vertical_axis && !on_horizontal_axis) {
+        int x = mirrored_coordinate(u, width);
+        int y = mirrored_coordinate(v, height);
+        if (x >= 0 && x < width && y >= 0 && y < height) {
+            *pixel = histogram->index(x, y);
+            return 1;
+        }
+        return 0;
+    }
 
-    std::vector<uint64_t> local_maxima(num_threads, 0);
-    std::vector<std::thread> threads;
+    // Points on a center line split evenly between two pixels under reflection,
+    // so bin their whole orbit exactly into the axis counters instead. The group
+    // maps the center lines onto each other, so every image is on one too.
+    std::complex<double> images[8];
+    symmetry.orbit(point, images);
+    for (int i = 0; i < symmetry.order(); ++i) {
+        double iu = (images[i].real() - real_min) / (real_max - real_min) * width;
+        double iv = (images[i].imag() - imag_min) / (imag_max - imag_min) * height;
+        bool vertical = width % 2 == 0 && std::abs(iu - width / 2) < 1e-7;
+        bool horizontal = height % 2 == 0 && std::abs(iv - height / 2) < 1e-7;
+        if (vertical && horizontal) {
+            axis_origin.fetch_add(count, std::memory_order_relaxed);
+        } else if (vertical) {
+            int y = mirrored_coordinate(iv, height);
+            if (y >= 0 && y < height) axis_column[y].fetch_add(count, std::memory_order_relaxed);
+        } else if (horizontal) {
+            int x = mirrored_coordinate(iu, width);
+            if (x >= 0 && x < width) axis_row[x].fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+    return 0;
+}
 
-    for (int i = 0; i < num_threads; ++i) {
-        threads.emplace_back([&, i]() {
-            int start = i * chunk_size;
-            int end = std::min(start + chunk_size, width * height);
-            uint64_t local_max = 0;
-            for (int j = start; j < end; ++j) {
-                local_max = std::max(local_max, histogram[j].load(std::memory_order_relaxed));
+int ImageHistogram::pixel_orbit(int x, int y, size_t* indices) const {
+    int k = 0;
+    for (int reflect = 0; reflect <= (symmetry.has_conjugation() ? 1 : 0); ++reflect) {
+        int px = x;
+        int py = reflect ? height - 1 - y : y;
+        for (int turns = 0; turns < 4; turns += symmetry.rotation_step()) {
+            indices[k++] = histogram->index(px, py);
+            for (int s = 0; s < symmetry.rotation_step(); ++s) {
+                int rotated_x = width - 1 - py;
+                py = px;
+                px = rotated_x;
             }
-            local_maxima[i] = local_max;
-        });
+        }
     }
+    return k;
+}
 
-    for (auto& thread : threads) {
-        thread.join();
+void ImageHistogram::apply_symmetry() {
+    if (!mirror_on_render) {
+        return;
     }
 
+    // Replace every pixel by the sum over the group of its images. Each pixel
+    // orbit is handled by the task that owns its lowest index, so the orbits
+    // can be folded in place without locking.
+    workers().parallel_for(height, 16, [&](int, uint64_t begin, uint64_t end) {
+        size_t indices[8];
+        for (int y = static_cast<int>(begin); y < static_cast<int>(end); ++y) {
+            for (int x = 0; x < width; ++x) {
+                const size_t self = histogram->index(x, y);
+                const int images = pixel_orbit(x, y, indices);
+                if (*std::min_element(indices, indices + images) != self) {
+                    continue;
+                }
+                // Orbits entirely in untouched tiles are empty; don't fault their pages in.
+                if (std::none_of(indices, indices + images, [&](size_t index) {
+                        return histogram->touched(TileStore::tile_of(index));
+                    })) {
+                    continue;
+                }
+                uint64_t total = 0;
+                for (int k = 0; k < images; ++k) {
+                    total += histogram->load(indices[k]);
+                }
+                for (int k = 0; k < images; ++k) {
+                    histogram->store(indices[k], total);
+                }
+            }
+        }
+    });
+
+    // The axis counters already hold whole orbits; put them where plain
+    // truncation would have binned a point on the center line.
+    auto add_axis_count = [&](int x, int y, const std::atomic<uint64_t>& count) {
+        if (uint64_t value = count.load(std::memory_order_relaxed)) {
+            histogram->add(histogram->index(x, y), value);
+        }
+    };
+    if (width % 2 == 0) {
+        for (int y = 0; y < height; ++y) {
+            add_axis_count(width / 2, y, axis_column[y]);
+        }
+    }
+    if (height % 2 == 0) {
+        for (int x = 0; x < width; ++x) {
+            add_axis_count(x, height / 2, axis_row[x]);
+        }
+        if (width % 2 == 0) {
+            add_axis_count(width / 2, height / 2, axis_origin);
+        }
+    }
+
+    mirror_on_render = false;
+    symmetry = SymmetryGroup();
+}
+
+void ImageHistogram::merge(std::vector<LocalHistogram>& locals) {
+    if (locals.empty()) {
+        return;
+    }
+
+    // Only tiles some accumulator touched need draining.
+    std::vector<size_t> touched;
+    for (const auto& local : locals) {
+        touched.insert(touched.end(), local.tile_indices.begin(), local.tile_indices.end());
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+    workers().parallel_for(touched.size(), 16, [&](int, uint64_t begin, uint64_t end) {
+        for (uint64_t k = begin; k < end; ++k) {
+            for (auto& local : locals) {
+                local.drain_tile(touched[k]);
+            }
+        }
+    });
+
+    for (auto& local : locals) {
+        local.clear_tiles();
+    }
+}
+
+bool ImageHistogram::write_to_file(const std::string& filename, uint64_t samples, const std::string& generator,
+                                   const std::string& metadata) {
+    apply_symmetry();
+
+    HistogramHeader header;
+    header.kind = HistogramHeader::Kind::Image;
+    header.resolution = resolution;
+    header.width = width;
+    header.height = height;
+    header.real_min = real_min;
+    header.real_max = real_max;
+    header.imag_min = imag_min;
+    header.imag_max = imag_max;
+    header.samples = samples;
+    header.generator = generator;
+    header.metadata = metadata;
+
+    HistogramWriter writer(filename, header);
+    if (!writer.is_open()) {
+        return false;
+    }
+    append_counts(writer);
+    if (!writer.finish()) {
+        LOG_ERROR << "Error occurred while writing histogram to " << filename;
+        return false;
+    }
+    return true;
+}
+
+bool ImageHistogram::load_from_file(const std::string& filename, HistogramHeader* loaded_header) {
+    HistogramReader reader(filename);
+    if (!reader.is_open()) {
+        return false;
+    }
+    const HistogramHeader& header = reader.header();
+    int64_t row, column;
+    uint64_t count;
+    if (header.kind == HistogramHeader::Kind::PMF) {
+        // PMF bins are lattice points in the complex plane.
+        while (reader.next(row, column, count)) {
+            add_point({column * header.bin_size, row * header.bin_size}, count);
+        }
+        if (!reader.is_open()) {
+            return false;
+        }
+        if (loaded_header) {
+            *loaded_header = header;
+        }
+        return true;
+    }
+    if (header.kind != HistogramHeader::Kind::Image) {
+        LOG_ERROR << filename << " does not hold an image histogram or a PMF";
+        return false;
+    }
+
+    const bool same_grid = header.width == width && header.height == height &&
+                           header.real_min == real_min && header.real_max == real_max &&
+                           header.imag_min == imag_min && header.imag_max == imag_max;
+    if (!same_grid) {
+        LOG_INFO << "Viewport of " << filename << " differs from the current one; re-binning pixel centers";
+    }
+
+    const double pixel_width = (header.real_max - header.real_min) / header.width;
+    const double pixel_height = (header.imag_max - header.imag_min) / header.height;
+    while (reader.next(row, column, count)) {
+        if (row < 0 || row >= header.height || column < 0 || column >= header.width) {
+            LOG_ERROR << "Bin (" << row << ", " << column << ") out of range in " << filename;
+            return false;
+        }
+        if (same_grid) {
+            histogram->add(histogram->index(column, row), count);
+        } else {
+            add_point({header.real_min + (column + 0.5) * pixel_width,
+                       header.imag_min + (row + 0.5) * pixel_height}, count);
+        }
+    }
+    if (!reader.is_open()) {
+        return false;
+    }
+
+    if (loaded_header) {
+        *loaded_header = header;
+    }
+    return true;
+}
+
+// Snapshot bodies hold the pixel rows, then, while mirroring is pending, the
+// axis counters as three extra rows: axis_row, axis_column and the origin.
+bool ImageHistogram::write_snapshot(const std::string& filename, const std::string& metadata) const {
+    HistogramHeader header;
+    header.kind = HistogramHeader::Kind::Snapshot;
+    header.resolution = resolution;
+    header.width = width;
+    header.height = height;
+    header.real_min = real_min;
+    header.real_max = real_max;
+    header.imag_min = imag_min;
+    header.imag_max = imag_max;
+    header.metadata = metadata;
+
+    HistogramWriter writer(filename, header);
+    if (!writer.is_open()) {
+        return false;
+    }
+    append_counts(writer);
+    if (mirror_on_render) {
+        for (int x = 0; x < width; ++x) {
+            writer.append(height, x, axis_row[x].load(std::memory_order_relaxed));
+        }
+        for (int y = 0; y < height; ++y) {
+            writer.append(height + 1, y, axis_column[y].load(std::memory_order_relaxed));
+        }
+        writer.append(height + 2, 0, axis_origin.load(std::memory_order_relaxed));
+    }
+    if (!writer.finish()) {
+        LOG_ERROR << "Error occurred while writing snapshot to " << filename;
+        return false;
+    }
+    return true;
+}
+
+bool ImageHistogram::read_snapshot(const std::string& filename, std::string& metadata) {
+    HistogramReader reader(filename);
+    if (!reader.is_open()) {
+        return false;
+    }
+    const HistogramHeader& header = reader.header();
+    if (header.kind != HistogramHeader::Kind::Snapshot || header.width != width || header.height != height ||
+        header.real_min != real_min || header.real_max != real_max ||
+        header.imag_min != imag_min || header.imag_max != imag_max) {
+        LOG_ERROR << filename << " is not a snapshot of this histogram";
+        return false;
+    }
+
+    histogram->clear();
+    if (mirror_on_render) {
+        for (int i = 0; i < height; ++i) axis_column[i].store(0, std::memory_order_relaxed);
+        for (int i = 0; i < width; ++i) axis_row[i].store(0, std::memory_order_relaxed);
+        axis_origin.store(0, std::memory_order_relaxed);
+    }
+
+    int64_t row, column;
+    uint64_t count;
+    while (reader.next(row, column, count)) {
+        int64_t limit = 0;
+        if (row < height) {
+            limit = width;
+        } else if (mirror_on_render) {
+            limit = row == height ? width : row == height + 1 ? height : row == height + 2 ? 1 : 0;
+        }
+        if (row < 0 || column < 0 || column >= limit) {
+            LOG_ERROR << "Bin (" << row << ", " << column << ") out of range in " << filename
+                      << (mirror_on_render ? "" : "; was it written with a different symmetry?");
+            return false;
+        }
+        if (row < height) {
+            histogram->store(histogram->index(column, row), count);
+        } else if (row == height) {
+            axis_row[column].store(count, std::memory_order_relaxed);
+        } else if (row == height + 1) {
+            axis_column[column].store(count, std::memory_order_relaxed);
+        } else {
+            axis_origin.store(count, std::memory_order_relaxed);
+        }
+    }
+    if (!reader.is_open()) {
+        return false;
+    }
+    metadata = header.metadata;
+    return true;
+}
+
+void ImageHistogram::append_counts(HistogramWriter& writer) const {
+    // Untouched tiles hold no counts, so whole row segments can be skipped.
+    for (int y = 0; y < height; ++y) {
+        for (int tile_x = 0; tile_x < histogram->tiles_x(); ++tile_x) {
+            const int x0 = tile_x * TileStore::TILE_SIZE;
+            if (!histogram->touched(TileStore::tile_of(histogram->index(x0, y)))) {
+                continue;
+            }
+            for (int x = x0; x < std::min(width, x0 + TileStore::TILE_SIZE); ++x) {
+                writer.append(y, x, histogram->load(histogram->index(x, y)));
+            }
+        }
+    }
+}
+
+uint64_t ImageHistogram::parallel_max() {
+    std::vector<uint64_t> local_maxima(workers().thread_count(), 0);
+    workers().parallel_for(histogram->tile_count(), 16, [&](int worker, uint64_t begin, uint64_t end) {
+        uint64_t local_max = local_maxima[worker];
+        for (size_t tile = begin; tile < end; ++tile) {
+            if (!histogram->touched(tile)) {
+                continue;
+            }
+            for (size_t j = tile * TileStore::TILE_AREA; j < (tile + 1) * TileStore::TILE_AREA; ++j) {
+                local_max = std::max(local_max, histogram->load(j));
+            }
+        }
+        local_maxima[worker] = local_max;
+    });
     return *std::max_element(local_maxima.begin(), local_maxima.end());
 }
 
-// void ImageHistogram::save_image(const std::string& filename, double gamma, std::string color_map, const EigenvaluePMF& pmf) {
-//     // Iterate over all bins in the PMF, and add the count to the histogram.
-//     for (const auto& [discretized_ev, count_atomic] : pmf.bins) {
-//         uint64_t count = count_atomic.load(std::memory_order_relaxed);
-//         if (count == 0) continue;
-
-//         // Un-discretize the eigenvalue
-//         std::complex<double> ev = pmf.undiscretize(discretized_ev);
-
-//         // Map the eigenvalue to image coordinates
-//         int x = static_cast<int>((ev.real() - real_min) / (real_max - real_min) * width);
-//         int y = static_cast<int>((ev.imag() - imag_min) / (imag_max - imag_min) * height);
-
-//         // Ensure the coordinates are within bounds
-//         if (x >= 0 && x < width && y >= 0 && y < height) {
-//             histogram[y * width + x].fetch_add(count, std::memory_order_relaxed);
-//         }
-//     }
-
-//     // Find the maximum count in the histogram
-//     uint64_t max_count = parallel_max();
-
-//     // Calculate log(max_count + 1) once
-//     double log_max = std::log(max_count + 1);
-
-//     tinycolormap::ColormapType color_map_type;
-//     bool binary = false;
-//     if (color_map == "viridis") {
-//         color_map_type = tinycolormap::ColormapType::Viridis;
-//     } else if (color_map == "plasma") {
-//         color_map_type = tinycolormap::ColormapType::Plasma;
-//     } else if (color_map == "binary") {
-//         binary = true;
-//     } else {
-//         LOG_ERROR << "Unknown color map type! Defaulting to grayscale.";
-//         color_map_type = tinycolormap::ColormapType::Gray;
-//     }
-
-//     // Create the image
-//     std::vector<unsigned char> image(width * height * 3, 0);
-
-//     for (int y = 0; y < height; ++y) {
-//         for (int x = 0; x < width; ++x) {
-//             int index = (y * width + x) * 3;
-//             uint64_t count = histogram[y * width + x].load(std::memory_order_relaxed);
-
-//             if (binary) {
-//                 // Do a simple binary thresholding.
-//                 count = count > 0 ? 255 : 0;
-//                 image[index] = static_cast<unsigned char>(count);
-//                 image[index + 1] = static_cast<unsigned char>(count);
-//                 image[index + 2] = static_cast<unsigned char>(count);
-//                 continue;
-//             }
-//             if (count == 0) {
-//                 // Set color to black for zero count
-//                 image[index] = 0;     // R
-//                 image[index + 1] = 0; // G
-//                 image[index + 2] = 0; // B
-//             } else {
-//                 // Apply logarithmic scaling
-//                 double log_scaled = std::log(count + 1) / log_max;
-                
-//                 // Apply gamma correction
-//                 double gamma_corrected = std::pow(log_scaled, 1.0 / gamma);
-
-//                 tinycolormap::Color color = tinycolormap::GetColor(gamma_corrected, color_map_type);
-//                 image[index] = static_cast<unsigned char>(color.r() * 255);     // R
-//                 image[index + 1] = static_cast<unsigned char>(color.g() * 255); // G
-//                 image[index + 2] = static_cast<unsigned char>(color.b() * 255); // B
-//             }
-//         }
-//     }
-
-//     stbi_write_png(filename.c_str(), width, height, 3, image.data(), width * 3);
-// }
+/// Each worker adds the PMF shards it is handed through its own tiles, which
+/// are then merged, so no counter is contended.
+void ImageHistogram::save_image(const std::string& filename, double gamma, std::string color_map, const EigenvaluePMF& pmf) {
+    std::vector<LocalHistogram> locals;
+    for (int i = 0; i < workers().thread_count(); ++i) {
+        locals.emplace_back(*this);
+    }
+    workers().parallel_for(EigenvaluePMF::SHARDS, 1, [&](int worker, uint64_t begin, uint64_t end) {
+        for (uint64_t shard = begin; shard < end; ++shard) {
+            pmf.for_each_bin(static_cast<int>(shard), [&](const std::complex<int>& bin, uint64_t count) {
+                locals[worker].add_point(pmf.undiscretize(bin), count);
+            });
+        }
+    });
+    merge(locals);
+
+    save_from_histogram(filename, gamma, color_map);
+}
 
 void ImageHistogram::save_from_histogram(const std::string& filename, double gamma, std::string color_map) {
     // Create the output directory if it doesn't exist
@@ -150,12 +508,9 @@ void ImageHistogram::save_from_histogram(const std::string& filename, double gam
     // Prepend the output directory to the filename
     std::string output_filename = "output/" + filename;
 
+    apply_symmetry();
     uint64_t max_count = parallel_max();
     LOG_INFO << "Max bin count: " << max_count;
-    std::vector<unsigned char> image(width * height * 3, 0);
-
-    // Calculate log(max_count + 1) once
-    double log_max = std::log(max_count + 1);
 
     tinycolormap::ColormapType color_map_type;
     if (color_map == "viridis") {
@@ -167,35 +522,207 @@ void ImageHistogram::save_from_histogram(const std::string& filename, double gam
         color_map_type = tinycolormap::ColormapType::Gray;
     }
 
-    for (int y = 0; y < height; ++y) {
+    // Log scaling and gamma correction are folded into a table over quantized
+    // levels of log(count + 1) / log(max_count + 1); level 0 is reserved for
+    // empty pixels, which stay black.
+    std::vector<unsigned char> palette((COLOR_LEVELS + 1) * 3, 0);
+    for (int level = 1; level <= COLOR_LEVELS; ++level) {
+        double log_scaled = static_cast<double>(level - 1) / (COLOR_LEVELS - 1);
+        tinycolormap::Color color = tinycolormap::GetColor(std::pow(log_scaled, 1.0 / gamma), color_map_type);
+        palette[level * 3] = static_cast<unsigned char>(color.r() * 255);
+        palette[level * 3 + 1] = static_cast<unsigned char>(color.g() * 255);
+        palette[level * 3 + 2] = static_cast<unsigned char>(color.b() * 255);
+    }
+
+    // Most pixels hold small counts, so their levels are tabulated too and
+    // only the rare large counts pay for a std::log.
+    const double level_scale = (COLOR_LEVELS - 1) / std::log(max_count + 1);
+    const uint64_t small_counts = std::min<uint64_t>(max_count + 1, SMALL_COUNT_LEVELS);
+    std::vector<uint16_t> small_levels(small_counts, 0);
+    for (uint64_t count = 1; count < small_counts; ++count) {
+        small_levels[count] = static_cast<uint16_t>(1 + std::lround(std::log(count + 1) * level_scale));
+    }
+
+    auto render_row = [&](int y, std::vector<uint16_t>& levels, unsigned char* pixels) {
+        std::fill(levels.begin(), levels.end(), 0);
+        for (int tile_x = 0; tile_x < histogram->tiles_x(); ++tile_x) {
+            const int x0 = tile_x * TileStore::TILE_SIZE;
+            if (!histogram->touched(TileStore::tile_of(histogram->index(x0, y)))) {
+                continue;
+            }
+            for (int x = x0; x < std::min(width, x0 + TileStore::TILE_SIZE); ++x) {
+                uint64_t count = histogram->load(histogram->index(x, y));
+                levels[x] = count < small_counts
+                    ? small_levels[count]
+                    : static_cast<uint16_t>(1 + std::lround(std::log(count + 1) * level_scale));
+            }
+        }
         for (int x = 0; x < width; ++x) {
-            uint64_t count = histogram[y * width + x].load(std::memory_order_relaxed);
-            
-            int index = (y * width + x) * 3;
-            if (count == 0) {
-                // Set color to black for zero count
-                image[index] = 0;     // R
-                image[index + 1] = 0; // G
-                image[index + 2] = 0; // B
-            } else {
-                // Apply logarithmic scaling
-                double log_scaled = std::log(count + 1) / log_max;
-                
-                // Apply gamma correction
-                double gamma_corrected = std::pow(log_scaled, 1.0 / gamma);
-
-
-                tinycolormap::Color color = tinycolormap::GetColor(gamma_corrected, color_map_type);
-                image[index] = static_cast<unsigned char>(color.r() * 255);     // R
-                image[index + 1] = static_cast<unsigned char>(color.g() * 255); // G
-                image[index + 2] = static_cast<unsigned char>(color.b() * 255); // B
+            const unsigned char* color = palette.data() + levels[x] * 3;
+            pixels[x * 3] = color[0];
+            pixels[x * 3 + 1] = color[1];
+            pixels[x * 3 + 2] = color[2];
+        }
+    };
+
+    PngWriter png(output_filename, width, height);
+    if (!png.is_open()) {
+        return;
+    }
+
+    // Workers color and compress one tile row of pixels at a time, taking
+    // strips in order. Whoever completes the oldest unwritten strip appends it
+    // and any finished ones after it. Workers stay at most `window` strips
+    // ahead of the file, which bounds memory by the window and not the image;
+    // the oldest unwritten strip is always being worked on, so nobody waits
+    // forever.
+    const int strip_rows = TileStore::TILE_SIZE;
+    const int strip_count = (height + strip_rows - 1) / strip_rows;
+    const int window = 2 * workers().thread_count();
+    std::vector<PngWriter::Strip> strips(window);
+    std::vector<bool> ready(window, false);
+    int written = 0;
+    bool ok = true;
+    std::mutex mutex;
+    std::condition_variable strip_written;
+    std::atomic<int> next_strip(0);
+
+    workers().run_workers([&](int) {
+        std::vector<uint16_t> levels(width);
+        // Row 0 holds the row above the strip, which PNG filters predict from.
+        std::vector<unsigned char> pixels(static_cast<size_t>(strip_rows + 1) * width * 3);
+        for (int strip = next_strip++; strip < strip_count; strip = next_strip++) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                strip_written.wait(lock, [&] { return strip < written + window; });
+            }
+            const int y0 = strip * strip_rows;
+            const int y1 = std::min(height, y0 + strip_rows);
+            for (int y = std::max(0, y0 - 1); y < y1; ++y) {
+                render_row(y, levels, pixels.data() + static_cast<size_t>(y - y0 + 1) * width * 3);
+            }
+            PngWriter::Strip compressed = png.compress_strip(strip > 0 ? pixels.data() : nullptr,
+                                                             pixels.data() + width * 3, y1 - y0,
+                                                             strip == strip_count - 1);
+            const size_t first_tile = static_cast<size_t>(strip) * histogram->tiles_x();
+            histogram->release(first_tile, first_tile + histogram->tiles_x());
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                strips[strip % window] = std::move(compressed);
+                ready[strip % window] = true;
+                while (written < strip_count && ready[written % window]) {
+                    ok = png.append(strips[written % window]) && ok;
+                    strips[written % window] = PngWriter::Strip();
+                    ready[written % window] = false;
+                    written++;
+                }
             }
+            strip_written.notify_all();
         }
+    });
+    if (!png.finish() || !ok) {
+        LOG_ERROR << "Error occurred while writing image to " << output_filename;
+    }
+}
+
+LocalHistogram::LocalHistogram(ImageHistogram& histogram, size_t memory_budget)
+    : target(&histogram),
+      memory_budget(memory_budget) {}
+
+void LocalHistogram::add_point(const std::complex<double>& point, uint64_t count) {
+    if (!target->may_contain(point)) {
+        return;
+    }
+    size_t pixels[8];
+    int found = target->locate(point, count, pixels);
+    for (int i = 0; i < found; ++i) {
+        increment(pixels[i], count);
     }
+}
 
-    stbi_write_png(output_filename.c_str(), width, height, 3, image.data(), width * 3);
+LocalHistogram::Tile& LocalHistogram::tile_for(size_t index) {
+    if (index != cached_index) {
+        uint64_t slot = tile_slots.get(index);
+        if (slot == 0) {
+            if (bytes + TILE_SIZE * TILE_SIZE * sizeof(uint16_t) > memory_budget) {
+                flush();
+            }
+            tiles.emplace_back();
+            tiles.back().narrow = std::make_unique<uint16_t[]>(TILE_SIZE * TILE_SIZE);
+            tile_indices.push_back(index);
+            slot = tiles.size();
+            tile_slots.add(index, slot);
+            bytes += TILE_SIZE * TILE_SIZE * sizeof(uint16_t);
+        }
+        cached_index = index;
+        cached_slot = slot - 1;
+    }
+    return tiles[cached_slot];
 }
 
-ImageHistogram::~ImageHistogram() {
-    delete[] histogram;
-}
\ No newline at end of file
+void LocalHistogram::increment(size_t pixel, uint64_t count) {
+    Tile& tile = tile_for(TileStore::tile_of(pixel));
+    const size_t offset = pixel & (TileStore::TILE_AREA - 1);
+
+    if (tile.narrow) {
+        if (tile.narrow[offset] + count <= UINT16_MAX) {
+            tile.narrow[offset] += static_cast<uint16_t>(count);
+            return;
+        }
+        promote(tile);
+    }
+
+    uint64_t total = tile.wide[offset] + count;
+    if (total <= UINT32_MAX) {
+        tile.wide[offset] = static_cast<uint32_t>(total);
+    } else {
+        target->histogram->add(pixel, total);
+        tile.wide[offset] = 0;
+    }
+}
+
+void LocalHistogram::promote(Tile& tile) {
+    tile.wide = std::make_unique<uint32_t[]>(TILE_SIZE * TILE_SIZE);
+    std::copy(tile.narrow.get(), tile.narrow.get() + TILE_SIZE * TILE_SIZE, tile.wide.get());
+    tile.narrow.reset();
+    bytes += TILE_SIZE * TILE_SIZE * (sizeof(uint32_t) - sizeof(uint16_t));
+}
+
+void LocalHistogram::drain_tile(size_t index) {
+    const uint64_t slot = tile_slots.get(index);
+    if (slot == 0) {
+        return;
+    }
+    Tile& tile = tiles[slot - 1];
+    if (!tile.narrow && !tile.wide) {
+        return;
+    }
+
+    // Local tiles share the shared histogram's layout, so counts add offset
+    // for offset; padding past the image edge is never counted.
+    const size_t base = index * TileStore::TILE_AREA;
+    for (size_t offset = 0; offset < TileStore::TILE_AREA; ++offset) {
+        uint64_t count = tile.narrow ? tile.narrow[offset] : tile.wide[offset];
+        if (count != 0) {
+            target->histogram->add(base + offset, count);
+        }
+    }
+
+    tile.narrow.reset();
+    tile.wide.reset();
+}
+
+void LocalHistogram::clear_tiles() {
+    tiles.clear();
+    tile_indices.clear();
+    tile_slots.clear();
+    cached_index = SIZE_MAX;
+    bytes = 0;
+}
+
+void LocalHistogram::flush() {
+    for (size_t index : tile_indices) {
+        drain_tile(index);
+    }
+    clear_tiles();
+}
@@ -1,24 +1,167 @@
 #pragma once
 
 #include <vector> 
+#include <algorithm>
 #include <complex>
 #include <string>
 #include <cstdint>
 #include <atomic>
+#include <memory>
 
+#include "bin_table.h"
 #include "eigenvalue.h"
+#include "symmetry.h"
+#include "histogram_file.h"
+#include "scheduler.h"
+#include "tile_store.h"
+
+class LocalHistogram;
 
 class ImageHistogram {
 public:
-    ImageHistogram(int resolution, double rmin, double rmax, double imin, double imax);
-    ~ImageHistogram();
-    void add_point(const std::complex<double>& point);
-    uint64_t parallel_max() const;
-    // void save_image(const std::string& filename, double gamma, std::string color_map, const EigenvaluePMF& pmf);
+    // A `spill_file` backs the counters by a memory-mapped file (see TileStore).
+    ImageHistogram(int resolution, double rmin, double rmax, double imin, double imax,
+                   const std::string& spill_file = std::string());
+    void add_point(const std::complex<double>& point, uint64_t count = 1);
+    // Cheap test ruling out points none of whose binned images can land in the
+    // viewport. add_point() starts with it, so binning into several views
+    // costs little for the points outside most of them.
+    bool may_contain(const std::complex<double>& point) const {
+        if (orbit_filter) {
+            // Every symmetry preserves |z|, so test the ring the viewport spans.
+            const double norm = std::norm(point);
+            return norm >= orbit_norm_min && norm <= orbit_norm_max;
+        }
+        return point.real() >= real_min && point.real() <= real_max &&
+               point.imag() >= imag_min && point.imag() <= imag_max;
+    }
+    // Treat every added point as standing for its orbit under `symmetry`. When the
+    // viewport is symmetric too, points are binned once and the counts are
+    // reflected and rotated in pixel space by apply_symmetry() before rendering;
+    // otherwise each point is binned once per group element.
+    void set_symmetry(const SymmetryGroup& symmetry);
+    // Runs the parallel stages below (symmetry fold, merge, rendering) on
+    // `scheduler`, which must outlive them. Without one they get a scheduler
+    // of their own on every core.
+    void set_scheduler(Scheduler& scheduler);
+    // Folds pending mirrored counts into the histogram. Called by save_from_histogram().
+    void apply_symmetry();
+    // Adds the counts held by per-thread accumulators and clears them. Tiles are
+    // reduced in parallel, a range of tile indices per task, so no two threads
+    // touch the same part of the histogram.
+    void merge(std::vector<LocalHistogram>& locals);
+    uint64_t parallel_max();
+    // Writes the counts as a histogram file (see histogram_file.h), applying any
+    // pending symmetry first. `samples` is the number of matrices they stand for;
+    // `metadata` is stored in the header (e.g. the work units an enumeration covered).
+    bool write_to_file(const std::string& filename, uint64_t samples, const std::string& generator,
+                       const std::string& metadata = std::string());
+    // Adds the counts stored in an image histogram file. A file binned over the
+    // same viewport and size loads bin for bin; any other is re-binned at its
+    // pixel centers. PMF files (see EigenvaluePMF) are binned at their lattice
+    // points, so they render at any viewport.
+    bool load_from_file(const std::string& filename, HistogramHeader* header = nullptr);
+    // Checkpoint support. A snapshot holds the counts as they stand, before any
+    // pending symmetry is folded, so a restored run keeps mirroring at render
+    // time; `metadata` is stored alongside them. Restoring replaces the current
+    // counts and requires the same viewport and size.
+    bool write_snapshot(const std::string& filename, const std::string& metadata) const;
+    bool read_snapshot(const std::string& filename, std::string& metadata);
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    // Side of the smaller pixel dimension in the complex plane.
+    double pixel_size() const { return std::min((real_max - real_min) / width, (imag_max - imag_min) / height); }
+    // Adds the bins of `pmf` at their lattice points and renders the counts
+    // with save_from_histogram().
+    void save_image(const std::string& filename, double gamma, std::string color_map, const EigenvaluePMF& pmf);
+    // Renders the counts to output/<filename> as a PNG, streamed in strips of
+    // one tile row that are colored and compressed in parallel.
     void save_from_histogram(const std::string& filename, double gamma, std::string color_map);
 
 private:
+    // Quantized levels of the log-scaled count used by the renderer's palette,
+    // and the counts below which levels are tabulated rather than computed.
+    static constexpr int COLOR_LEVELS = 4096;
+    static constexpr uint64_t SMALL_COUNT_LEVELS = 1 << 16;
+
+    int resolution;
     int width, height;
     double real_min, real_max, imag_min, imag_max;
-    std::atomic<uint64_t> *histogram;
+    std::unique_ptr<TileStore> histogram;
+    Scheduler* scheduler = nullptr;
+    std::unique_ptr<Scheduler> own_scheduler;  // Made on first use when none was set
+    SymmetryGroup symmetry;
+    bool mirror_on_render = false;
+    // Set while points are binned once per orbit image; see may_contain().
+    bool orbit_filter = false;
+    double orbit_norm_min = 0, orbit_norm_max = 0;
+    // Whole orbits of points on the center lines of even-sized axes, which
+    // cannot be mirrored pixel-exactly.
+    std::unique_ptr<std::atomic<uint64_t>[]> axis_column, axis_row;
+    std::atomic<uint64_t> axis_origin{0};
+
+    // Writes the counter indices (TileStore::index) of the pixels `point`
+    // contributes `count` to (one per orbit image when
+    // binning per orbit) and returns how many. Points on a mirror center line go
+    // straight into the axis counters and yield none.
+    int locate(const std::complex<double>& point, uint64_t count, size_t* pixels);
+    int locate_pixel(const std::complex<double>& point, size_t* pixel) const;
+    int locate_mirrored(const std::complex<double>& point, uint64_t count, size_t* pixel);
+    // Writes the counter indices of the images of (x, y) under the group, with repeats.
+    int pixel_orbit(int x, int y, size_t* indices) const;
+    // Appends the nonzero counts in (row, column) order.
+    void append_counts(HistogramWriter& writer) const;
+    bool viewport_has_symmetry(const SymmetryGroup& symmetry) const;
+    Scheduler& workers();
+
+    friend class LocalHistogram;
+};
+
+// Per-thread accumulator for an ImageHistogram. Counts go into private, lazily
+// allocated tiles of 16-bit counters, widened to 32 bits the first time one of
+// them would overflow, so workers don't bounce the shared atomic counters'
+// cache lines between cores. Only touched tiles are kept, found through a
+// BinTable by tile index, so neither an accumulator's size nor a flush grows
+// with the image.
+// Hand the accumulators to ImageHistogram::merge() to fold them in; an
+// accumulator that outgrows its memory budget flushes itself with atomic adds.
+class LocalHistogram {
+public:
+    // Tiles line up with the shared histogram's.
+    static constexpr int TILE_BITS = TileStore::TILE_BITS;
+    static constexpr int TILE_SIZE = TileStore::TILE_SIZE;
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 64ULL * 1024 * 1024;
+
+    explicit LocalHistogram(ImageHistogram& histogram, size_t memory_budget = DEFAULT_MEMORY_BUDGET);
+    LocalHistogram(LocalHistogram&&) = default;
+
+    void add_point(const std::complex<double>& point, uint64_t count = 1);
+    // Adds every count to the shared histogram with atomic adds and clears.
+    void flush();
+
+private:
+    struct Tile {
+        std::unique_ptr<uint16_t[]> narrow;
+        std::unique_ptr<uint32_t[]> wide;
+    };
+
+    ImageHistogram* target;
+    std::vector<Tile> tiles;          // Touched tiles, in the order first touched
+    std::vector<size_t> tile_indices; // Shared-histogram index of each tile
+    BinTable tile_slots;              // Tile index -> position in tiles, plus one
+    size_t cached_index = SIZE_MAX;   // Last tile looked up, and its position
+    size_t cached_slot = 0;
+    size_t bytes = 0;
+    size_t memory_budget;
+
+    void increment(size_t pixel, uint64_t count);
+    Tile& tile_for(size_t index);
+    void promote(Tile& tile);
+    // Adds tile `index` into the shared histogram and releases its counters,
+    // leaving the index as it is, so that merge() can drain tiles concurrently.
+    void drain_tile(size_t index);
+    // Forgets every tile, once all have been drained.
+    void clear_tiles();
+
+    friend class ImageHistogram;
 };
\ No newline at end of file
@@ -9,209 +9,879 @@
 #include <fstream>
 #include <mutex>
 #include <iomanip>
+#include <memory>
+#include <limits>
+#include <algorithm>
 
 #include "matrix.h"
 #include "matrix_generator.h"
+#include "static_matrix_generator.h"
+#include "reduced_sampler.h"
+#include "spectrum_memo.h"
 #include "image.h"
 #include "logger.h"
 #include "util.h"
 #include "eigenvalue.h"
+#include "eigen_solver.h"
+#include "enumerator.h"
+#include "symmetry.h"
+#include "histogram_file.h"
+#include "eigenvalue_writer.h"
+#include "eigenvalue_reader.h"
+#include "checkpoint.h"
+#include "scheduler.h"
+#include "telemetry.h"
 
 #include "json.h"
 using json = nlohmann::json;
 
-// Function to write eigenvalues to a binary file
-void write_eigenvalues_to_file(const std::vector<std::complex<double>>& eigenvalues, const std::string& filename) {
-    // TODO: Instead of just saving a vector of eigenvalues, construct a histogram of eigenvalues and save the histogram to a file.
-    //       Allows us to use some sort of RLE compression. Additionally, the process of loading and plotting the eigenvalues could 
-    //       potentially be much faster, since incrementing a bin for each eigenvalue would be a single operation.
-    const size_t MAX_FILE_SIZE = 10ULL * 1024 * 1024 * 1024; // 10 GB limit
-    size_t size = eigenvalues.size();
-    size_t total_size = sizeof(size_t) + size * sizeof(std::complex<double>);
-
-    if (total_size > MAX_FILE_SIZE) {
-        size_t max_eigenvalues = (MAX_FILE_SIZE - sizeof(size_t)) / sizeof(std::complex<double>);
-        size = max_eigenvalues;
-        total_size = sizeof(size_t) + size * sizeof(std::complex<double>);
-        LOG_ERROR << "File size exceeds the limit. Writing only " << size << " eigenvalues.";
+// Load configuration from JSON file
+bool load_config(const std::string& filename, json& config) {
+    std::ifstream config_file(filename);
+    if (!config_file.is_open()) {
+        std::cerr << "Error: Unable to open config file." << std::endl;
+        return false;
     }
-
-    std::ofstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
-        LOG_ERROR << "Failed to open file for writing: " << filename;
-        return;
+    try {
+        config_file >> config;
+    } catch (const json::parse_error& e) {
+        std::cerr << "Error: Failed to parse config file. " << e.what() << std::endl;
+        return false;
     }
+    return true;
+}
 
-    file.write(reinterpret_cast<const char*>(&size), sizeof(size_t));
-    file.write(reinterpret_cast<const char*>(eigenvalues.data()), size * sizeof(std::complex<double>));
+// One window onto the complex plane and how to render it. Every eigenvalue
+// is binned into all views, so zoomed insets share the eigensolves of the
+// full picture.
+struct View {
+    std::unique_ptr<ImageHistogram> histogram;
+    std::vector<LocalHistogram> locals;  // Per-thread tiles when binning is tiled
+    std::string output_file;
+    std::string color_map;
+    double gamma;
+    // Appended to the names of files written per view (histogram dumps,
+    // checkpoints, spill files); empty for the first view.
+    std::string suffix;
+};
 
-    if (file.good()) {
-        LOG_INFO << "Succesfully wrote: " << std::scientific << std::setprecision(2) << static_cast<double>(size) << " eigenvalues";
-        LOG_INFO << "Total size: " << total_size / (1024 * 1024) << " MB.";
-    } else {
-        LOG_ERROR << "Error occurred while writing eigenvalues to " << filename;
+// `visualization_params` holds one view or a list of them. A view's
+// "resolution" defaults to the top-level one. The views merge and render on
+// `scheduler`.
+std::vector<View> load_views(const json& config, const std::string& spill_file, Scheduler& scheduler) {
+    const json& params = config["visualization_params"];
+    std::vector<json> entries = params.is_array() ? params.get<std::vector<json>>() : std::vector<json>{params};
+    std::vector<View> views;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const json& entry = entries[i];
+        View view;
+        view.suffix = i == 0 ? std::string() : ".view" + std::to_string(i);
+        view.histogram = std::make_unique<ImageHistogram>(
+            entry.value("resolution", config["resolution"].get<int>()), entry["real_min"], entry["real_max"],
+            entry["imaginary_min"], entry["imaginary_max"], spill_file.empty() ? spill_file : spill_file + view.suffix);
+        view.histogram->set_scheduler(scheduler);
+        view.output_file = entry["output_file"];
+        view.color_map = entry["color_map"];
+        view.gamma = entry["gamma"];
+        assert(view.gamma > 0);
+        views.push_back(std::move(view));
     }
-    file.close();
+    return views;
 }
 
-// Function to load eigenvalues from a binary file
-std::vector<std::complex<double>> load_eigenvalues_from_file(const std::string& filename) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
-        LOG_ERROR << "Failed to open file for reading: " << filename;
-        return {};
+// Merges one view's shards into its histogram file and renders it.
+int merge_view(const json& config, View& view, const std::vector<std::string>& shards, Scheduler& scheduler) {
+    ImageHistogram& plane = *view.histogram;
+    std::vector<HistogramHeader> headers(shards.size());
+    std::atomic<bool> failed(false);
+    scheduler.parallel_for(shards.size(), 1, [&](int, uint64_t begin, uint64_t end) {
+        for (uint64_t k = begin; k < end; k++) {
+            if (!plane.load_from_file(shards[k], &headers[k])) {
+                failed = true;
+            }
+        }
+    });
+    if (failed) {
+        LOG_ERROR << "Failed to load all shards. Exiting.";
+        return 1;
     }
 
-    size_t size;
-    file.read(reinterpret_cast<char*>(&size), sizeof(size_t));
-
-    std::vector<std::complex<double>> eigenvalues(size);
-    file.read(reinterpret_cast<char*>(eigenvalues.data()), size * sizeof(std::complex<double>));
+    uint64_t samples = 0;
+    for (size_t k = 0; k < shards.size(); k++) {
+        if (!headers[k].compatible_with(headers.front())) {
+            LOG_ERROR << "Shard " << shards[k] << " was binned differently from " << shards.front() << ". Exiting.";
+            return 1;
+        }
+        samples += headers[k].samples;
+    }
+    LOG_INFO << "Merged " << shards.size() << " shards standing for " << samples << " samples";
 
-    if (file.good()) {
-        LOG_INFO << "Successfully loaded: " << std::scientific << std::setprecision(2) << static_cast<double>(size) << " eigenvalues";
-        LOG_INFO << "Total size: " << (sizeof(size_t) + size * sizeof(std::complex<double>)) / (1024 * 1024) << " MB.";
-    } else {
-        LOG_ERROR << "Error occurred while reading eigenvalues from " << filename;
-        eigenvalues.clear();
+    const std::string merged_file = config["eigenvalues"]["file"].get<std::string>() + view.suffix;
+    if (plane.write_to_file(merged_file, samples, headers.front().generator)) {
+        LOG_INFO << "Wrote merged histogram to " << merged_file;
     }
-    file.close();
+    LOG_INFO << "Saving image...";
+    plane.save_from_histogram(view.output_file, view.gamma, view.color_map);
+    LOG_INFO << "Finished saving image";
+    return 0;
+}
 
-    return eigenvalues;
+// `bohemia merge <config> <shards...>`: sums the histogram shards written by
+// --shard runs into the config's eigenvalue file and renders the image, view
+// by view. Shards are loaded concurrently into the shared atomic histogram, on
+// the config's "threads". PMF shards (one per run, whatever the views) are
+// summed file to file first.
+int merge_shards(const json& config, const std::vector<std::string>& shards) {
+    const auto parallelism = Scheduler::allow_threads(config.value("threads", 0));
+    Scheduler scheduler(config.value("threads", 0));
+    if (config.value("binning", std::string("tiled")) == "pmf") {
+        const std::string merged_file = config["eigenvalues"]["file"];
+        if (!merge_histogram_files(shards, merged_file)) {
+            LOG_ERROR << "Failed to merge PMF shards. Exiting.";
+            return 1;
+        }
+        LOG_INFO << "Wrote merged PMF to " << merged_file;
+        for (auto& view : load_views(config, config.value("spill_file", std::string()), scheduler)) {
+            if (!view.histogram->load_from_file(merged_file)) {
+                return 1;
+            }
+            LOG_INFO << "Saving image " << view.output_file << "...";
+            view.histogram->save_from_histogram(view.output_file, view.gamma, view.color_map);
+        }
+        return 0;
+    }
+    for (auto& view : load_views(config, config.value("spill_file", std::string()), scheduler)) {
+        std::vector<std::string> view_shards;
+        for (const auto& shard : shards) {
+            view_shards.push_back(shard + view.suffix);
+        }
+        if (merge_view(config, view, view_shards, scheduler) != 0) {
+            return 1;
+        }
+    }
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <path_to_config_file>" << std::endl;
+    const std::string usage = std::string("Usage: ") + argv[0] + " <path_to_config_file> [--resume] [--shard k/M]\n"
+                            + "       " + argv[0] + " merge <path_to_config_file> <shard files...>";
+    if (argc < 2) {
+        std::cerr << usage << std::endl;
         return 1;
     }
 
-    // Load configuration from JSON file
-    std::ifstream config_file(argv[1]);
-    if (!config_file.is_open()) {
-        std::cerr << "Error: Unable to open config file." << std::endl;
-        return 1;
+    if (std::string(argv[1]) == "merge") {
+        json config;
+        if (argc < 4 || !load_config(argv[2], config)) {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+        return merge_shards(config, std::vector<std::string>(argv + 3, argv + argc));
+    }
+
+    bool resume = false;
+    int shard_index = 0, shard_count = 1;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--resume") {
+            resume = true;
+        } else if (arg == "--shard" && i + 1 < argc &&
+                   std::sscanf(argv[++i], "%d/%d", &shard_index, &shard_count) == 2 &&
+                   shard_index >= 0 && shard_index < shard_count) {
+            continue;
+        } else {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
     }
+    const bool sharded = shard_count > 1;
 
     json config;
-    try {
-        config_file >> config;
-    } catch (const json::parse_error& e) {
-        std::cerr << "Error: Failed to parse config file. " << e.what() << std::endl;
+    if (!load_config(argv[1], config)) {
         return 1;
     }
 
-    GlobalSeedGenerator::initialize(std::chrono::system_clock::now().time_since_epoch().count());
-
     // Extract parameters from config
-    int resolution = config["resolution"];
-    int samples = config["samples"];
+    uint64_t samples = config["samples"];
     int precision = config["precision"];
     auto& eigenvalue_config = config["eigenvalues"];
     bool ignore_reals = config["ignore_reals"];
     std::string eigenvalue_mode = eigenvalue_config["mode"];
-    std::string eigenvalue_file = eigenvalue_config["file"];
+    // "load" accepts a list of files, which are summed.
+    std::vector<std::string> eigenvalue_files;
+    if (eigenvalue_config["file"].is_array()) {
+        eigenvalue_files = eigenvalue_config["file"].get<std::vector<std::string>>();
+    } else {
+        eigenvalue_files.push_back(eigenvalue_config["file"]);
+    }
+    std::string eigenvalue_file = eigenvalue_files.front();
+    // Shards write a histogram next to the configured file and leave the
+    // image to `bohemia merge`.
+    const std::string shard_suffix = "." + std::to_string(shard_index) + "-of-" + std::to_string(shard_count);
+    if (sharded) {
+        if (eigenvalue_mode != "sample" && eigenvalue_mode != "dump") {
+            LOG_ERROR << "Only sampling runs can be sharded. Exiting.";
+            return 1;
+        }
+        eigenvalue_mode = "dump";
+        eigenvalue_file += shard_suffix;
+    }
+    // Dumps are histogram files unless raw eigenvalues are asked for.
+    std::string eigenvalue_format = sharded ? "histogram" : eigenvalue_config.value("format", std::string("histogram"));
+
+    // Sampling runs can be checkpointed every `interval` seconds and resumed with --resume.
+    json checkpoint_config = config.value("checkpoint", json::object());
+    std::string checkpoint_file = checkpoint_config.value("file", std::string());
+    int checkpoint_interval = checkpoint_config.value("interval", 600);
+    if (sharded && !checkpoint_file.empty()) {
+        checkpoint_file += shard_suffix;
+    }
+    json hashed_config = config;
+    hashed_config.erase("checkpoint");
+    hashed_config.erase("threads");  // Results do not depend on these
+    hashed_config.erase("spill_file");
+    const uint64_t shared_config_hash = hash_config(hashed_config.dump());
+    hashed_config["shard"] = shard_suffix;
+    const uint64_t config_hash = hash_config(hashed_config.dump());
     
-    // Extract visualization parameters
-    auto& visualization_params = config["visualization_params"];
-    double real_min = visualization_params["real_min"];
-    double real_max = visualization_params["real_max"];
-    double imaginary_min = visualization_params["imaginary_min"];
-    double imaginary_max = visualization_params["imaginary_max"];
-    std::string output_file = visualization_params["output_file"];
-    std::string color_map = visualization_params["color_map"];
-    double gamma = visualization_params["gamma"];
-    assert(gamma > 0);
-
-    // Define plane using the loaded parameters
-    auto plane = ImageHistogram(resolution, real_min, real_max, imaginary_min, imaginary_max);
-
-    int num_threads = std::thread::hardware_concurrency();
-    int samples_per_thread = samples / num_threads;
+    // Define the views using the loaded parameters. Gigapixel planes can
+    // spill their counters to a memory-mapped file instead of RAM.
+    std::string spill_file = config.value("spill_file", std::string());
+    if (sharded && !spill_file.empty()) {
+        spill_file += shard_suffix;
+    }
+    // Every Scheduler of the run, the PMF's and the views' included, uses at
+    // most these threads.
+    const auto parallelism = Scheduler::allow_threads(config.value("threads", 0));
+    Scheduler scheduler(config.value("threads", 0));
+    const int num_threads = scheduler.thread_count();
+    std::vector<View> views = load_views(config, spill_file, scheduler);
+    LOG_INFO << "Binning into " << views.size() << (views.size() == 1 ? " view" : " views");
+    // The run report defaults to output/<first image name>.report.json.
+    const std::string& output_file = views.front().output_file;
+    const std::string report_file = config.value("report", "output/" + output_file.substr(0, output_file.rfind('.')) + ".report.json");
+
+    // "mixed" solves in single precision and re-solves in double whatever
+    // misses the tolerance, by default a tenth of the finest pixel.
+    double solver_tolerance = 0;
+    if (config.value("solver_precision", std::string("double")) == "mixed") {
+        solver_tolerance = std::numeric_limits<double>::max();
+        for (const auto& view : views) {
+            solver_tolerance = std::min(solver_tolerance, 0.1 * view.histogram->pixel_size());
+        }
+        solver_tolerance = config.value("solver_tolerance", solver_tolerance);
+    }
+    // Matrix family to sample; each is solved by the LAPACK driver suited to
+    // its structure (see EigenSolver).
+    MatrixStructure family = MatrixStructure::Tridiagonal;
+    const std::string family_name = config.value("family", std::string("tridiagonal"));
+    if (!parse_structure(family_name, family)) {
+        LOG_ERROR << "Unknown family: " << family_name;
+        return 1;
+    }
+    if (solver_tolerance > 0 && family != MatrixStructure::Dense && family != MatrixStructure::Tridiagonal) {
+        LOG_ERROR << "Mixed precision supports the dense and tridiagonal families only; solving " << family_name
+                  << " in double precision";
+        solver_tolerance = 0;
+    }
+    if (solver_tolerance > 0) {
+        LOG_INFO << "Mixed-precision solves with tolerance " << solver_tolerance;
+    }
+    // "aberth" finds tridiagonal or companion eigenvalues as polynomial roots,
+    // batch-wide. Companion matrices store their polynomial, so they default to it.
+    const std::string solver_engine = config.value("solver_engine",
+        std::string(family == MatrixStructure::Companion ? "aberth" : "lapack"));
+    if (solver_engine != "lapack" && solver_engine != "aberth") {
+        LOG_ERROR << "Unknown solver_engine: " << solver_engine;
+        return 1;
+    }
+    // "reduced" draws diagonals and off-diagonal products instead of raw
+    // entries and solves them block by block through a per-thread memo.
+    const std::string sampler_name = config.value("sampler", std::string("entries"));
+    if (sampler_name != "entries" && sampler_name != "reduced") {
+        LOG_ERROR << "Unknown sampler: " << sampler_name;
+        return 1;
+    }
+    const bool reduced_sampler = sampler_name == "reduced";
+    if ((reduced_sampler || eigenvalue_mode == "enumerate") && family != MatrixStructure::Tridiagonal) {
+        LOG_ERROR << "The reduced sampler and enumeration need the tridiagonal family";
+        return 1;
+    }
+    const size_t memo_entries = config.value("memo_entries", size_t(1) << 16);
+    if (reduced_sampler && solver_engine == "aberth") {
+        LOG_INFO << "The reduced sampler solves blocks of varying size with LAPACK; ignoring solver_engine";
+    }
+
+    // Value set of the generator used below: "complex" (BohemianValues) or
+    // "real" (RealBohemianValues), the index of the table in Generator.
+    using Generator = FamilyGenerator<10, BohemianValues, RealBohemianValues>;
+    const std::string value_set = config.value("values", std::string("complex"));
+    if (value_set != "complex" && value_set != "real") {
+        LOG_ERROR << "Unknown values: " << value_set;
+        return 1;
+    }
+    const int value_table = value_set == "real" ? 1 : 0;
+    const std::vector<std::complex<double>> values = value_table == 1
+        ? std::vector<std::complex<double>>(RealBohemianValues::values.begin(), RealBohemianValues::values.end())
+        : std::vector<std::complex<double>>(BohemianValues::values.begin(), BohemianValues::values.end());
+    const std::string generator_description = std::string(structure_name(family)) + " n=10 values=" +
+        (value_table == 1 ? RealBohemianValues::description : BohemianValues::description);
+    if (reduced_sampler && value_table != 0) {
+        LOG_ERROR << "The reduced sampler draws from the complex value set only";
+        return 1;
+    }
+    // Matrices over a real value set are solved in real arithmetic, unless a
+    // complex-only fast path (Aberth, mixed precision) was asked for.
+    const bool real_arithmetic = solver_engine == "lapack" && solver_tolerance == 0 &&
+        std::all_of(values.begin(), values.end(), [](const std::complex<double>& value) { return value.imag() == 0; });
+    if (real_arithmetic) {
+        LOG_INFO << "Real value set; solving in real arithmetic";
+    }
+
+    // Histogram files already hold mirrored counts; raw eigenvalues don't.
+    // "render" only projects stored histograms or PMFs into the views.
+    const bool rendering = eigenvalue_mode == "render";
+    bool loading_histograms = (eigenvalue_mode == "load" || rendering) && is_histogram_file(eigenvalue_file);
+    const std::string binning = config.value("binning", std::string("tiled"));
+    const bool pmf_binning = binning == "pmf" && !rendering;
+
+    // Each sampled matrix stands for its whole orbit under the value set's
+    // symmetries, so only a fraction of the requested samples need solving.
+    int symmetry_order = 1;
+    SymmetryGroup symmetry;
+    if (config.value("exploit_symmetry", true) && eigenvalue_mode != "enumerate" && !loading_histograms) {
+        symmetry = SymmetryGroup::detect(values);
+        if (ignore_reals) {
+            // Quarter turns move points on and off the real axis, which the filter looks at.
+            symmetry = symmetry.without_quarter_turns();
+        }
+        if (family == MatrixStructure::Hermitian) {
+            // i A is not Hermitian, and conjugation fixes the real spectrum,
+            // so it would only count each sample twice: negation is left.
+            symmetry = symmetry.without_quarter_turns().without_conjugation();
+        }
+        // A PMF is unfolded into whole orbits before it is rendered (see
+        // finish_binning below), so it renders the same as when loaded later.
+        if (!pmf_binning) {
+            for (auto& view : views) {
+                view.histogram->set_symmetry(symmetry);
+            }
+        }
+        if (eigenvalue_mode != "load" && !symmetry.is_trivial()) {
+            symmetry_order = symmetry.order();
+            samples = (samples + symmetry.order() - 1) / symmetry.order();
+            LOG_INFO << "Drawing " << samples << " samples, each standing for " << symmetry.order() << " matrices";
+        }
+    }
+
+    // A seed in the config makes runs reproducible; otherwise shards derive a
+    // common one from the config and single runs take the clock. Each shard
+    // draws from its own range of jump-separated streams.
+    const uint64_t base_seed = config.contains("seed") ? config["seed"].get<uint64_t>()
+                             : sharded ? shared_config_hash
+                             : static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+    // Generators are reseeded for every block; their default seeds come from
+    // the run's seed too, so nothing else in a seeded run reads the clock.
+    GlobalSeedGenerator::initialize(base_seed);
+    if (sharded) {
+        samples = samples / shard_count + (static_cast<uint64_t>(shard_index) < samples % shard_count ? 1 : 0);
+        LOG_INFO << "Shard " << shard_index << " of " << shard_count << " writes " << eigenvalue_file;
+    }
+
     LOG_INFO << "Total samples: " << samples;
-    LOG_INFO << "Samples per thread: " << samples_per_thread;
     LOG_INFO << "Number of threads: " << num_threads;
 
-    std::vector<std::thread> threads;
-    std::atomic<int> progress(0);
-    std::vector<std::vector<std::complex<double>>> all_eigenvalues(num_threads);
-    std::mutex eigenvalues_mutex;
+    Telemetry telemetry(num_threads);
+    const int main_slot = telemetry.main_slot();
+    auto write_report = [&]() {
+        // Shards name their report run.report.0-of-4.json, keeping the extension.
+        std::string file = report_file;
+        if (sharded) {
+            const std::string extension = ".json";
+            const bool has_extension = file.size() >= extension.size() &&
+                                       file.compare(file.size() - extension.size(), extension.size(), extension) == 0;
+            file.insert(has_extension ? file.size() - extension.size() : file.size(), shard_suffix);
+        }
+        json extra = {{"mode", eigenvalue_mode}, {"symmetry_order", symmetry_order}, {"views", views.size()}};
+        if (telemetry.write_report(file, extra)) {
+            LOG_INFO << "Wrote run report to " << file;
+        }
+    };
+
+    // Workers bin into private tiles that get merged at the end, unless the
+    // config asks for binning straight into the shared atomic counters. "pmf"
+    // bins into a viewport-independent EigenvaluePMF of side 10^-precision
+    // instead, which the views are rendered from at the end and which dumps
+    // store, so the run can be rendered at any viewport later.
+    const bool tiled_binning = binning == "tiled";
+    if (tiled_binning) {
+        for (auto& view : views) {
+            for (int i = 0; i < num_threads; i++) {
+                view.locals.emplace_back(*view.histogram);
+            }
+        }
+    }
+    EigenvaluePMF pmf = EigenvaluePMF::with_precision(precision);
+    std::vector<LocalPMF> pmf_locals;
+    if (pmf_binning) {
+        LOG_INFO << "Binning into a PMF with bins of side " << pmf.bin_size();
+        for (const auto& view : views) {
+            if (pmf.bin_size() > view.histogram->pixel_size()) {
+                LOG_INFO << "PMF bins are coarser than the pixels of " << view.output_file << "; raise precision for a sharper image";
+            }
+        }
+        for (int i = 0; i < num_threads; i++) {
+            pmf_locals.emplace_back(pmf);
+        }
+    }
+    // Views that cannot contain the point reject it with a bounds test.
+    auto bin_point = [&](int thread_id, const std::complex<double>& point, uint64_t count) {
+        if (pmf_binning) {
+            pmf_locals[thread_id].insert(point, count);
+            return;
+        }
+        for (auto& view : views) {
+            if (tiled_binning) {
+                view.locals[thread_id].add_point(point, count);
+            } else {
+                view.histogram->add_point(point, count);
+            }
+        }
+    };
+    auto merge_locals = [&]() {
+        for (auto& view : views) {
+            view.histogram->merge(view.locals);
+        }
+    };
+    // Merges the workers' bins; a PMF is also unfolded into whole orbits.
+    auto finish_binning = [&]() {
+        if (pmf_binning) {
+            pmf.merge(pmf_locals, scheduler);
+            pmf.apply_symmetry(symmetry, scheduler);
+            LOG_INFO << "PMF holds " << pmf.bin_count() << " bins";
+        }
+        merge_locals();
+    };
+
+    if (rendering) {
+        // Nothing is sampled or solved. PMF files are decoded a chunk at a
+        // time and every chunk is projected into all views by all threads;
+        // image histograms are loaded by all views at once, re-binned where the
+        // viewports differ.
+        const size_t chunk_size = 1 << 20;
+        std::vector<std::pair<std::complex<double>, uint64_t>> chunk;
+        for (const auto& file : eigenvalue_files) {
+            HistogramReader reader(file);
+            if (!reader.is_open()) {
+                LOG_ERROR << "Only histogram and PMF files can be rendered: " << file;
+                return 1;
+            }
+            const HistogramHeader header = reader.header();
+            if (header.kind == HistogramHeader::Kind::PMF) {
+                int64_t row, column;
+                uint64_t count;
+                bool more = true;
+                while (more) {
+                    chunk.clear();
+                    {
+                        Telemetry::Timer timer(telemetry, main_slot, Telemetry::IO);
+                        while (chunk.size() < chunk_size && (more = reader.next(row, column, count))) {
+                            chunk.emplace_back(std::complex<double>(column * header.bin_size, row * header.bin_size), count);
+                        }
+                    }
+                    scheduler.parallel_for(chunk.size(), 4096, [&](int thread_id, uint64_t begin, uint64_t end) {
+                        Telemetry::Timer timer(telemetry, thread_id, Telemetry::Bin);
+                        for (uint64_t k = begin; k < end; k++) {
+                            bin_point(thread_id, chunk[k].first, chunk[k].second);
+                        }
+                    });
+                }
+                if (!reader.is_open()) {
+                    LOG_ERROR << "Failed to read PMF. Exiting.";
+                    return 1;
+                }
+            } else {
+                Telemetry::Timer timer(telemetry, main_slot, Telemetry::IO);
+                std::atomic<bool> failed(false);
+                scheduler.parallel_for(views.size(), 1, [&](int, uint64_t begin, uint64_t end) {
+                    for (uint64_t v = begin; v < end; v++) {
+                        if (!views[v].histogram->load_from_file(file)) {
+                            failed = true;
+                        }
+                    }
+                });
+                if (failed) {
+                    LOG_ERROR << "Failed to load histogram. Exiting.";
+                    return 1;
+                }
+            }
+            LOG_INFO << "Rendering " << header.entries << " bins from " << file << " standing for "
+                     << header.samples << " samples of " << header.generator;
+        }
+        merge_locals();
+    } else if (eigenvalue_mode == "load") {
+        for (const auto& file : eigenvalue_files) {
+            if (is_histogram_file(file) != loading_histograms) {
+                LOG_ERROR << "Cannot mix histogram and raw eigenvalue files: " << file;
+                return 1;
+            }
+            if (loading_histograms) {
+                LOG_INFO << "Loading histogram from file: " << file;
+                // Every view loads the file, re-binning it where the viewports differ.
+                HistogramHeader header;
+                Telemetry::Timer timer(telemetry, main_slot, Telemetry::IO);
+                for (auto& view : views) {
+                    if (!view.histogram->load_from_file(file, &header)) {
+                        LOG_ERROR << "Failed to load histogram. Exiting.";
+                        return 1;
+                    }
+                }
+                LOG_INFO << "Loaded " << header.entries << " bins standing for " << header.samples << " samples of " << header.generator;
+                continue;
+            }
 
-    std::vector<std::complex<double>> eigenvalues;
+            LOG_INFO << "Loading eigenvalues from file: " << file;
+            EigenvalueReader reader(file);
+            if (!reader.is_open()) {
+                LOG_ERROR << "Failed to load eigenvalues. Exiting.";
+                return 1;
+            }
+            LOG_INFO << "Mapped " << std::scientific << std::setprecision(2) << static_cast<double>(reader.size()) << " eigenvalues";
 
-    if (eigenvalue_mode == "load") {
-        LOG_INFO << "Loading eigenvalues from file: " << eigenvalue_file;
-        eigenvalues = load_eigenvalues_from_file(eigenvalue_file);
-        if (eigenvalues.empty()) {
-            LOG_ERROR << "Failed to load eigenvalues. Exiting.";
+            // Workers bin blocks of the mapping and drop each block's pages
+            // once done, so resident memory stays small.
+            const uint64_t block_size = EigenvalueWriter::DEFAULT_CHUNK_SIZE * 16;
+            scheduler.parallel_for(reader.size(), block_size, [&](int thread_id, uint64_t begin, uint64_t end) {
+                Telemetry::Timer timer(telemetry, thread_id, Telemetry::Bin);
+                reader.prefetch(begin, end);
+                const std::complex<double>* data = reader.data();
+                for (uint64_t k = begin; k < end; k++) {
+                    bin_point(thread_id, data[k], 1);
+                }
+                reader.release(begin, end);
+                telemetry.add(thread_id, Telemetry::Eigenvalues, end - begin);
+            });
+        }
+        finish_binning();
+    } else if (eigenvalue_mode == "enumerate") {
+        // Walk every tridiagonal matrix over the value set instead of sampling.
+        TridiagonalEnumerator enumerator(eigenvalue_config.value("size", 10), values,
+                                         eigenvalue_config.value("prefix_depth", 0), 64ULL * num_threads);
+        if (enumerator.exact_matrix_count() == std::numeric_limits<uint64_t>::max()) {
+            LOG_ERROR << "Enumerating size " << enumerator.size() << " covers " << std::scientific << std::setprecision(2)
+                      << enumerator.matrix_count() << " matrices, more than a 64-bit sample count holds. Exiting.";
             return 1;
         }
-        // Plot the loaded eigenvalues
-        for (const auto& eigenvalue : eigenvalues) {
-            plane.add_point(eigenvalue);
+        const uint64_t first_unit = eigenvalue_config.value("first_unit", 0ULL);
+        const uint64_t last_unit = std::min<uint64_t>(eigenvalue_config.value("last_unit", enumerator.unit_count()), enumerator.unit_count());
+        LOG_INFO << "Enumerating " << std::scientific << std::setprecision(2) << enumerator.matrix_count()
+                 << " matrices of size " << enumerator.size() << " as " << enumerator.leaf_count() << " leaves";
+        LOG_INFO << "Work units " << first_unit << " to " << last_unit << " of " << enumerator.unit_count()
+                 << " (prefix depth " << enumerator.get_prefix_depth() << ")";
+
+        // Unit numbers depend on the prefix depth, which by default depends on
+        // the thread count; ranges meant to be summed must pin it.
+        if ((eigenvalue_config.contains("first_unit") || eigenvalue_config.contains("last_unit")) &&
+            !eigenvalue_config.contains("prefix_depth")) {
+            LOG_INFO << "Set eigenvalues.prefix_depth to keep unit numbers stable across runs of a split enumeration";
+        }
+
+        const uint64_t total_units = last_unit > first_unit ? last_unit - first_unit : 0;
+        telemetry.start_reporter(Telemetry::Units, total_units);
+
+        std::atomic<uint64_t> enumerated(0);
+        scheduler.parallel_for(total_units, 1, [&](int thread_id, uint64_t begin, uint64_t end) {
+            const int n = enumerator.size();
+            uint64_t binned = 0, matrices = 0;
+            auto visit = [&](const std::complex<double>* leaf_eigenvalues, uint64_t weight) {
+                matrices += weight;
+                for (int k = 0; k < n; k++) {
+                    if (ignore_reals && leaf_eigenvalues[k].imag() == 0) {
+                        continue;
+                    }
+                    bin_point(thread_id, leaf_eigenvalues[k], weight);
+                    binned++;
+                }
+            };
+            // Solving and binning interleave inside the walk, so whole units
+            // are timed as solve.
+            for (uint64_t unit = first_unit + begin; unit < first_unit + end; unit++) {
+                Telemetry::Timer timer(telemetry, thread_id, Telemetry::Solve);
+                enumerator.enumerate_unit(unit, visit);
+                telemetry.add(thread_id, Telemetry::Units, 1);
+            }
+            telemetry.add(thread_id, Telemetry::Eigenvalues, binned);
+            enumerated += matrices;
+        });
+        finish_binning();
+        telemetry.stop_reporter();
+
+        LOG_INFO << "Finished enumerating units " << first_unit << " to " << last_unit;
+
+        // The histograms record the unit range they cover, so ranges run as
+        // separate jobs can be summed by `bohemia merge` or a multi-file load.
+        Telemetry::Timer timer(telemetry, main_slot, Telemetry::IO);
+        const std::string enumerated_generator = std::string(structure_name(family)) + " n=" +
+            std::to_string(enumerator.size()) + " values=" +
+            (value_table == 1 ? RealBohemianValues::description : BohemianValues::description) + " enumerated";
+        const std::string unit_range = json{{"first_unit", first_unit}, {"last_unit", last_unit},
+                                            {"unit_count", enumerator.unit_count()},
+                                            {"prefix_depth", enumerator.get_prefix_depth()}}.dump();
+        if (pmf_binning) {
+            LOG_INFO << "Writing PMF to file: " << eigenvalue_file;
+            if (pmf.write_to_file(eigenvalue_file, enumerated, enumerated_generator, unit_range)) {
+                LOG_INFO << "Succesfully wrote PMF of " << enumerated << " matrices";
+            }
+        } else {
+            for (auto& view : views) {
+                LOG_INFO << "Writing histogram to file: " << eigenvalue_file + view.suffix;
+                if (view.histogram->write_to_file(eigenvalue_file + view.suffix, enumerated, enumerated_generator, unit_range)) {
+                    LOG_INFO << "Succesfully wrote histogram of " << enumerated << " matrices";
+                }
+            }
         }
     } else {
         LOG_INFO << "Plotting eigenvalues using " << num_threads << " threads";
-        std::cout << "Processing: " << std::flush;
 
-        auto worker = [&](int thread_id, int thread_samples) {
+        // Raw dumps stream through a writer thread; a few chunks per worker
+        // keep the disk busy while bounding memory.
+        const bool dump_raw = eigenvalue_mode == "dump" && eigenvalue_format == "raw";
+        std::unique_ptr<EigenvalueWriter> raw_writer;
+        if ((dump_raw || pmf_binning) && !checkpoint_file.empty()) {
+            LOG_ERROR << (dump_raw ? "Raw dumps" : "PMF runs") << " cannot be checkpointed; ignoring the checkpoint settings";
+            checkpoint_file.clear();
+        }
+        if (dump_raw) {
+            LOG_INFO << "Dumping eigenvalues to file: " << eigenvalue_file;
+            raw_writer = std::make_unique<EigenvalueWriter>(eigenvalue_file, 4 * num_threads);
+            if (!raw_writer->is_open()) {
+                return 1;
+            }
+        }
+        // Samples come in fixed-size blocks, each with its own stream, so the
+        // result only depends on the seed and the block size.
+        const uint64_t block_size = config.value("block_size", 4096ULL);
+        BlockDispatcher blocks(samples, block_size, stream_state(base_seed, shard_index));
+        RunState run_state;
+        run_state.config_hash = config_hash;
+        run_state.samples = samples;
+        if (resume) {
+            if (checkpoint_file.empty()) {
+                LOG_ERROR << "--resume needs a checkpoint file in the config. Exiting.";
+                return 1;
+            }
+            // Each view has its own checkpoint file, written as one set.
+            std::vector<std::string> view_checkpoints;
+            std::vector<ImageHistogram*> view_histograms;
+            for (auto& view : views) {
+                view_checkpoints.push_back(checkpoint_file + view.suffix);
+                view_histograms.push_back(view.histogram.get());
+            }
+            RunState saved;
+            if (!read_checkpoints(view_checkpoints, view_histograms, saved)) {
+                LOG_ERROR << "Failed to read checkpoint. Exiting.";
+                return 1;
+            }
+            if (saved.config_hash != config_hash || saved.samples != run_state.samples) {
+                LOG_ERROR << "Checkpoint " << checkpoint_file << " was taken with a different config. Exiting.";
+                return 1;
+            }
+            blocks.restore(saved.completed, saved.next_stream);
+            run_state.completed = saved.completed;
+            run_state.generation = saved.generation;
+            LOG_INFO << "Resuming from " << checkpoint_file << " with " << saved.completed << " samples done";
+        }
+        PausePoint pause_point;
+
+        auto worker = [&](int thread_id) {
             // Define matrix generator.
-            // TODO: Ignore eigenvalues with no imaginary component.
-            // TODO: Can exploit symmetry to and not need to store a large number of eigenvalues.
-            auto mat_gen = MatrixGenerator::tridiagonal<10>();
-            std::vector<std::complex<double>> local_eigenvalues;
-            for (int i = 0; i < thread_samples; i++) {
-                auto matrix = mat_gen.generate();
-                auto eigenvalues = matrix.compute_eigenvalues();
-                for (const auto& eigenvalue : eigenvalues) {
-                    if (ignore_reals && eigenvalue.real() == 0) {
-                        continue;
+            Generator mat_gen(family, value_table);
+            const int n = mat_gen.get_size();
+            const int batch_size = EigenSolver::DEFAULT_BATCH_SIZE;
+            EigenSolver solver(n, mat_gen.get_structure());
+            solver.use_mixed_precision(solver_tolerance);
+            if (solver_engine == "aberth") {
+                solver.use_aberth();
+            }
+            // Reseeded for every block, like mat_gen.
+            ReducedTridiagonalSampler<10> reduced_gen(0);
+            std::vector<ReducedTridiagonalSampler<10>::Sample> reduced_samples(reduced_sampler ? batch_size : 0);
+            std::unique_ptr<SpectrumMemo> memo;
+            if (reduced_sampler) {
+                memo = std::make_unique<SpectrumMemo>(n, reduced_gen.diagonal_values(), reduced_gen.product_values(), memo_entries);
+                memo->use_mixed_precision(solver_tolerance);
+            }
+            std::vector<std::complex<double>> matrices(real_arithmetic ? 0 : batch_size * solver.matrix_stride());
+            std::vector<double> real_matrices(real_arithmetic ? batch_size * solver.matrix_stride() : 0);
+            std::vector<std::complex<double>> eigenvalues(batch_size * n);
+            EigenvalueWriter::Chunk* chunk = dump_raw ? raw_writer->acquire() : nullptr;
+            BlockDispatcher::Block block;
+            pause_point.enter();
+            while (blocks.next(block)) {
+                mat_gen.set_state(block.rng);
+                reduced_gen.set_state(block.rng);
+                for (uint64_t i = block.begin; i < block.end; i += batch_size) {
+                    int batch = static_cast<int>(std::min<uint64_t>(batch_size, block.end - i));
+                    const uint64_t generate_start = Telemetry::cycles();
+                    uint64_t solve_start;
+                    int failures = 0;
+                    if (reduced_sampler) {
+                        for (int s = 0; s < batch; s++) {
+                            reduced_gen.draw(reduced_samples[s]);
+                        }
+                        solve_start = Telemetry::cycles();
+                        for (int s = 0; s < batch; s++) {
+                            failures += !memo->solve(reduced_samples[s].diagonal.data(), reduced_samples[s].product.data(),
+                                                     eigenvalues.data() + s * n);
+                        }
+                    } else if (real_arithmetic) {
+                        mat_gen.generate_batch(real_matrices.data(), batch);
+                        solve_start = Telemetry::cycles();
+                        failures = solver.solve_batch(real_matrices.data(), batch, eigenvalues.data());
+                    } else {
+                        mat_gen.generate_batch(matrices.data(), batch);
+                        solve_start = Telemetry::cycles();
+                        failures = solver.solve_batch(matrices.data(), batch, eigenvalues.data());
                     }
-                    plane.add_point(eigenvalue);
-                    if (eigenvalue_mode == "dump") {
-                        local_eigenvalues.push_back(eigenvalue);
+                    const uint64_t bin_start = Telemetry::cycles();
+                    uint64_t io_cycles = 0, binned = 0;
+                    for (int k = 0; k < batch * n; k++) {
+                        const auto& eigenvalue = eigenvalues[k];
+                        if (ignore_reals && eigenvalue.imag() == 0) {
+                            continue;
+                        }
+                        bin_point(thread_id, eigenvalue, 1);
+                        binned++;
+                        if (dump_raw) {
+                            chunk->push_back(eigenvalue);
+                            if (chunk->size() == raw_writer->chunk_size()) {
+                                // Time spent waiting on the writer counts as I/O.
+                                const uint64_t io_start = Telemetry::cycles();
+                                raw_writer->submit(chunk);
+                                chunk = raw_writer->acquire();
+                                io_cycles += Telemetry::cycles() - io_start;
+                            }
+                        }
                     }
+                    const uint64_t bin_end = Telemetry::cycles();
+
+                    telemetry.add_cycles(thread_id, Telemetry::Generate, solve_start - generate_start);
+                    telemetry.add_cycles(thread_id, Telemetry::Solve, bin_start - solve_start);
+                    telemetry.add_cycles(thread_id, Telemetry::Bin, bin_end - bin_start - io_cycles);
+                    telemetry.add_cycles(thread_id, Telemetry::IO, io_cycles);
+                    telemetry.add(thread_id, Telemetry::Samples, batch);
+                    telemetry.add(thread_id, Telemetry::Eigenvalues, binned);
+                    telemetry.add(thread_id, Telemetry::SolverFailures, failures);
                 }
-                
-                // Update progress
-                int current_progress = ++progress;
-                if (current_progress % (samples / 100) == 0) {
-                    std::cout << "\rProcessing: [" << std::string(current_progress / (samples / 100), '#') << std::string(100 - current_progress / (samples / 100), ' ') << "] " << current_progress / (samples / 100) << "%" << std::flush;
-                }
+                // Checkpoints are taken between blocks, when every handed-out
+                // block is fully binned.
+                pause_point.poll();
+            }
+            if (dump_raw) {
+                raw_writer->submit(chunk);
             }
-            if (eigenvalue_mode == "dump") {
-                std::lock_guard<std::mutex> lock(eigenvalues_mutex);
-                all_eigenvalues[thread_id] = std::move(local_eigenvalues);
+            telemetry.add(thread_id, Telemetry::DoubleFallbacks, solver.double_fallbacks());
+            if (memo) {
+                telemetry.add(thread_id, Telemetry::DoubleFallbacks, memo->double_fallbacks());
+                telemetry.add(thread_id, Telemetry::MemoLookups, memo->lookups());
+                telemetry.add(thread_id, Telemetry::MemoHits, memo->hits());
             }
+            pause_point.retire();
         };
 
-        // Spawn threads
-        for (int i = 0; i < num_threads; i++) {
-            threads.emplace_back(worker, i, samples_per_thread);
+        // Checkpoint periodically while the workers run. Workers are parked
+        // between blocks while the tiles are folded in and written. The
+        // parked workers hold the scheduler's arena, so this thread folds
+        // every local in by itself instead of going through merge().
+        std::atomic<bool> sampling_done(false);
+        std::thread checkpointer;
+        if (!checkpoint_file.empty()) {
+            checkpointer = std::thread([&]() {
+                auto last_checkpoint = std::chrono::steady_clock::now();
+                while (!sampling_done) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    if (std::chrono::steady_clock::now() - last_checkpoint < std::chrono::seconds(checkpoint_interval)) {
+                        continue;
+                    }
+                    pause_point.pause();
+                    {
+                        Telemetry::Timer timer(telemetry, main_slot, Telemetry::IO);
+                        for (auto& view : views) {
+                            for (auto& local : view.locals) {
+                                local.flush();
+                            }
+                        }
+                        run_state.completed = blocks.handed_out();
+                        run_state.next_stream = blocks.next_stream();
+                        run_state.generation++;
+                        std::vector<std::string> view_checkpoints;
+                        std::vector<const ImageHistogram*> view_histograms;
+                        for (const auto& view : views) {
+                            view_checkpoints.push_back(checkpoint_file + view.suffix);
+                            view_histograms.push_back(view.histogram.get());
+                        }
+                        if (write_checkpoints(view_checkpoints, view_histograms, run_state)) {
+                            LOG_DEBUG << "Checkpointed " << run_state.completed << " samples to " << checkpoint_file;
+                        }
+                    }
+                    pause_point.resume();
+                    last_checkpoint = std::chrono::steady_clock::now();
+                }
+            });
         }
 
-        // Wait for all threads to finish
-        for (auto& thread : threads) {
-            thread.join();
+        telemetry.start_reporter(Telemetry::Samples, samples, run_state.completed);
+        scheduler.run_workers(worker);
+        sampling_done = true;
+        if (checkpointer.joinable()) {
+            checkpointer.join();
         }
+        finish_binning();
+        telemetry.stop_reporter();
 
-        std::cout << "\rProcessing: [" << std::string(100, '#') << "] 100%" << std::endl;
         LOG_INFO << "Finished plotting eigenvalues";
+        if (telemetry.total(Telemetry::SolverFailures) > 0) {
+            LOG_ERROR << "LAPACK failed to converge on " << telemetry.total(Telemetry::SolverFailures) << " matrices";
+        }
+        Telemetry::Timer timer(telemetry, main_slot, Telemetry::IO);
 
-        if (eigenvalue_mode == "dump") {
-            LOG_INFO << "Dumping eigenvalues to file: " << eigenvalue_file;
-            std::vector<std::complex<double>> combined_eigenvalues;
-            for (const auto& thread_eigenvalues : all_eigenvalues) {
-                combined_eigenvalues.insert(combined_eigenvalues.end(), thread_eigenvalues.begin(), thread_eigenvalues.end());
+        if (eigenvalue_mode == "dump" && pmf_binning) {
+            uint64_t represented_samples = static_cast<uint64_t>(samples) * symmetry_order;
+            LOG_INFO << "Dumping PMF to file: " << eigenvalue_file;
+            if (pmf.write_to_file(eigenvalue_file, represented_samples, generator_description)) {
+                LOG_INFO << "Succesfully wrote PMF of " << represented_samples << " samples";
+            }
+        } else if (eigenvalue_mode == "dump" && !dump_raw) {
+            uint64_t represented_samples = static_cast<uint64_t>(samples) * symmetry_order;
+            for (auto& view : views) {
+                LOG_INFO << "Dumping histogram to file: " << eigenvalue_file + view.suffix;
+                if (view.histogram->write_to_file(eigenvalue_file + view.suffix, represented_samples, generator_description)) {
+                    LOG_INFO << "Succesfully wrote histogram of " << represented_samples << " samples";
+                }
+            }
+        } else if (dump_raw) {
+            if (raw_writer->finish()) {
+                LOG_INFO << "Succesfully wrote: " << std::scientific << std::setprecision(2) << static_cast<double>(raw_writer->written()) << " eigenvalues";
+                LOG_INFO << "Total size: " << (sizeof(size_t) + raw_writer->written() * sizeof(std::complex<double>)) / (1024 * 1024) << " MB.";
+            } else {
+                LOG_ERROR << "Error occurred while writing eigenvalues to " << eigenvalue_file;
             }
-            write_eigenvalues_to_file(combined_eigenvalues, eigenvalue_file);
         }
     }
 
-    // plane.save_image(output_file, gamma, color_map, pmf);
-    LOG_INFO << "Saving image...";
-    plane.save_from_histogram(output_file, gamma, color_map);
-    LOG_INFO << "Finished saving image";
+    if (!sharded) {
+        Telemetry::Timer timer(telemetry, main_slot, Telemetry::IO);
+        for (auto& view : views) {
+            LOG_INFO << "Saving image " << view.output_file << "...";
+            if (pmf_binning) {
+                view.histogram->save_image(view.output_file, view.gamma, view.color_map, pmf);
+            } else {
+                view.histogram->save_from_histogram(view.output_file, view.gamma, view.color_map);
+            }
+        }
+        LOG_INFO << "Finished saving images";
+    }
 
+    write_report();
     return 0;
 }
\ No newline at end of file
@@ -2,53 +2,170 @@
 #include <cassert>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 
-#include "logger.h"
+#include "eigen_solver.h"
 
-// Declare the LAPACK routine
-extern "C" {
-    void zgeev_(char* jobvl, char* jobvr, int* n, std::complex<double>* a,
-                int* lda, std::complex<double>* w, std::complex<double>* vl,
-                int* ldvl, std::complex<double>* vr, int* ldvr,
-                std::complex<double>* work, int* lwork, double* rwork,
-                int* info);
+int storage_size(MatrixStructure structure, int n) {
+    switch (structure) {
+        case MatrixStructure::Tridiagonal:     return n > 0 ? 3 * n - 2 : 0;
+        case MatrixStructure::UpperHessenberg: return n > 0 ? n * (n + 1) / 2 + n - 1 : 0;
+        case MatrixStructure::Toeplitz:        return n > 0 ? 2 * n - 1 : 0;
+        case MatrixStructure::Companion:       return n;
+        case MatrixStructure::Hermitian:       return n * (n + 1) / 2;
+        case MatrixStructure::Dense:
+        default:                               return n * n;
+    }
+}
+
+namespace {
+
+// First stored value of column `col` of an upper Hessenberg matrix: columns
+// before it hold col + 2 values each (the last column is cut off at n).
+int hessenberg_column_start(int col) {
+    return col * (col + 3) / 2;
 }
 
-Matrix::Matrix(int n, std::vector<std::complex<double>> _values) {
+} // namespace
+
+void storage_position(MatrixStructure structure, int n, int k, int& row, int& col) {
+    switch (structure) {
+        case MatrixStructure::Tridiagonal:
+            if (k < n) {
+                row = col = k;
+            } else if (k < 2 * n - 1) {
+                col = k - n;
+                row = col + 1;
+            } else {
+                row = k - (2 * n - 1);
+                col = row + 1;
+            }
+            return;
+        case MatrixStructure::UpperHessenberg:
+            for (col = 0; col + 1 < n && hessenberg_column_start(col + 1) <= k; ++col) {}
+            row = k - hessenberg_column_start(col);
+            return;
+        case MatrixStructure::Toeplitz:
+            row = std::max(0, k - (n - 1));
+            col = row - (k - (n - 1));
+            return;
+        case MatrixStructure::Companion:
+            row = k;
+            col = n - 1;
+            return;
+        case MatrixStructure::Hermitian:
+            for (col = 0; (col + 1) * (col + 2) / 2 <= k; ++col) {}
+            row = k - col * (col + 1) / 2;
+            return;
+        case MatrixStructure::Dense:
+        default:
+            row = k / n;
+            col = k % n;
+            return;
+    }
+}
+
+const char* structure_name(MatrixStructure structure) {
+    switch (structure) {
+        case MatrixStructure::Tridiagonal:     return "tridiagonal";
+        case MatrixStructure::UpperHessenberg: return "hessenberg";
+        case MatrixStructure::Toeplitz:        return "toeplitz";
+        case MatrixStructure::Companion:       return "companion";
+        case MatrixStructure::Hermitian:       return "hermitian";
+        case MatrixStructure::Dense:
+        default:                               return "dense";
+    }
+}
+
+bool parse_structure(const std::string& name, MatrixStructure& structure) {
+    for (auto candidate : {MatrixStructure::Dense, MatrixStructure::Tridiagonal, MatrixStructure::UpperHessenberg,
+                           MatrixStructure::Toeplitz, MatrixStructure::Companion, MatrixStructure::Hermitian}) {
+        if (name == structure_name(candidate)) {
+            structure = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+Matrix::Matrix(int n, std::vector<std::complex<double>> _values, MatrixStructure structure) {
     size = n;
     values = std::move(_values);
-    assert(static_cast<int>(values.size()) == n * n && "Number of values must match the matrix size");
+    structure_ = structure;
+    assert(static_cast<int>(values.size()) == storage_size(structure, n) && "Number of values must match the matrix size");
+}
+
+int Matrix::index(int row, int col) const {
+    switch (structure_) {
+        case MatrixStructure::Tridiagonal:
+            if (row == col) return row;
+            if (row == col + 1) return size + col;         // sub-diagonal
+            if (row + 1 == col) return 2 * size - 1 + row; // super-diagonal
+            return -1;
+        case MatrixStructure::UpperHessenberg:
+            return row <= col + 1 ? hessenberg_column_start(col) + row : -1;
+        case MatrixStructure::Toeplitz:
+            return row - col + size - 1;
+        case MatrixStructure::Companion:
+            return col == size - 1 ? row : -1;
+        case MatrixStructure::Hermitian:
+            return row <= col ? row + col * (col + 1) / 2 : -1;
+        case MatrixStructure::Dense:
+        default:
+            return row * size + col;
+    }
 }
 
 std::complex<double> Matrix::get(int row, int col) const {
     assert(row >= 0 && row < size && col >= 0 && col < size && "Matrix indices out of range");
-    return values[row * size + col];
+    if (structure_ == MatrixStructure::Companion && row == col + 1) {
+        return 1;
+    }
+    if (structure_ == MatrixStructure::Hermitian) {
+        if (row == col) return values[index(row, col)].real();
+        return row < col ? values[index(row, col)] : std::conj(values[index(col, row)]);
+    }
+    int i = index(row, col);
+    return i < 0 ? std::complex<double>(0, 0) : values[i];
 }
 
 void Matrix::set(int row, int col, std::complex<double> value) {
     assert(row >= 0 && row < size && col >= 0 && col < size && "Matrix indices out of range");
-    values[row * size + col] = value;
+    assert(!(structure_ == MatrixStructure::Companion && row == col + 1) && "The companion sub-diagonal is fixed");
+    if (structure_ == MatrixStructure::Hermitian && row > col) {
+        // The lower triangle mirrors the upper one.
+        std::swap(row, col);
+        value = std::conj(value);
+    }
+    int i = index(row, col);
+    assert((i >= 0 || value == std::complex<double>(0, 0)) && "Cannot set a structurally zero entry");
+    if (i >= 0) {
+        values[i] = value;
+    }
 }
 
 std::complex<double>* Matrix::data() {
     return values.data();
 }
 
+bool Matrix::is_real() const {
+    return std::all_of(values.begin(), values.end(), [](const std::complex<double>& value) {
+        return value.imag() == 0;
+    });
+}
+
 std::vector<std::complex<double>> Matrix::compute_eigenvalues() {
-    int n = size;  // Assuming square matrix
-    char jobvl = 'N', jobvr = 'N';
-    int lda = n, ldvl = 1, ldvr = 1, info, lwork = 4*n;
-    std::vector<std::complex<double>> w(n), work(lwork);
-    std::vector<double> rwork(2*n);
-
-    zgeev_(&jobvl, &jobvr, &n, this->data(), &lda, w.data(), nullptr,
-           &ldvl, nullptr, &ldvr, work.data(), &lwork, rwork.data(), &info);
-
-    if (info != 0) {
-        LOG_ERROR << "ZGEEV failed with error code " << info;
-        return std::vector<std::complex<double>>(n, 0);
+    // Convenience path for one-off solves; hot loops should keep an EigenSolver around.
+    EigenSolver solver(size, structure_);
+    std::vector<std::complex<double>> w(size);
+    if (is_real()) {
+        std::vector<double> real_values(values.size());
+        std::transform(values.begin(), values.end(), real_values.begin(),
+                       [](const std::complex<double>& value) { return value.real(); });
+        solver.solve(real_values.data(), w.data());
+    } else {
+        solver.solve(this->data(), w.data());
     }
-
     return w;
 }
 
@@ -3,20 +3,49 @@
 #include <vector>
 #include <complex>
 #include <iostream>
+#include <string>
+
+// Storage layout of a matrix. Structured matrices only store their
+// structurally nonzero entries so the solver can skip work on the zeros.
+enum class MatrixStructure {
+    Dense,            // n*n values, row-major
+    Tridiagonal,      // 3n-2 values: main diagonal, sub-diagonal, super-diagonal
+    UpperHessenberg,  // n(n+1)/2 + n-1 values: column by column, rows 0 to j+1 of column j
+    Toeplitz,         // 2n-1 values: entry (i, j) is value i - j + n-1
+    Companion,        // n values: the last column; the sub-diagonal is all ones
+    Hermitian         // n(n+1)/2 values: upper triangle column by column; diagonals count by their real part
+};
+
+// Number of stored values for an n x n matrix with the given structure.
+int storage_size(MatrixStructure structure, int n);
+// Row and column of the k-th stored value; for Toeplitz matrices, the first
+// entry of its diagonal.
+void storage_position(MatrixStructure structure, int n, int k, int& row, int& col);
+// Config names: "dense", "tridiagonal", "hessenberg", "toeplitz", "companion", "hermitian".
+const char* structure_name(MatrixStructure structure);
+bool parse_structure(const std::string& name, MatrixStructure& structure);
 
 class Matrix {
 public:
-    Matrix(int n, std::vector<std::complex<double>> values);
+    Matrix(int n, std::vector<std::complex<double>> values, MatrixStructure structure = MatrixStructure::Dense);
     std::complex<double> get(int row, int col) const;
     void set(int row, int col, std::complex<double> value);
     std::complex<double>* data();
+    // True if no stored entry has an imaginary part.
+    bool is_real() const;
+    // Solves in real arithmetic when is_real().
     std::vector<std::complex<double>> compute_eigenvalues();
+    MatrixStructure structure() const { return structure_; }
     int size;
 
     friend std::ostream& operator<<(std::ostream& os, const Matrix& matrix);
 
 private:
     std::vector<std::complex<double>> values;
+    MatrixStructure structure_;
+
+    // Index into `values` for (row, col), or -1 if the entry is structurally zero.
+    int index(int row, int col) const;
 };
 
-std::ostream& operator<<(std::ostream& os, const Matrix& matrix);
\ No newline at end of file
+std::ostream& operator<<(std::ostream& os, const Matrix& matrix);
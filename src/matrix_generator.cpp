@@ -2,17 +2,49 @@
 
 #include "logger.h"
 
-MatrixGenerator::MatrixGenerator(int size, std::function<std::complex<double>(int, int)> generator)
-    : size(size), generator(generator) {}
+MatrixGenerator::MatrixGenerator(int size, std::function<std::complex<double>(int, int)> generator,
+                                 MatrixStructure structure)
+    : size(size), generator(generator), structure(structure) {}
 
 /// Generate a matrix of size n x n with random values>
 Matrix MatrixGenerator::generate() const {
-    std::vector<std::complex<double>> values(size * size);
-    for (int i = 0; i < size; ++i) {
-        for (int j = 0; j < size; ++j) {
-            values[i * size + j] = generator(i, j);
+    std::vector<std::complex<double>> values(storage_size(structure, size));
+    generate_into(values.data());
+    return Matrix(size, std::move(values), structure);
+}
+
+void MatrixGenerator::generate_into(std::complex<double>* values) const {
+    if (structure == MatrixStructure::Tridiagonal) {
+        // Only visit the three diagonals, in the order Matrix stores them.
+        int k = 0;
+        for (int i = 0; i < size; ++i) {
+            values[k++] = generator(i, i);
+        }
+        for (int i = 0; i + 1 < size; ++i) {
+            values[k++] = generator(i + 1, i);
+        }
+        for (int i = 0; i + 1 < size; ++i) {
+            values[k++] = generator(i, i + 1);
+        }
+    } else if (structure == MatrixStructure::Dense) {
+        for (int i = 0; i < size; ++i) {
+            for (int j = 0; j < size; ++j) {
+                values[i * size + j] = generator(i, j);
+            }
+        }
+    } else {
+        const int stride = storage_size(structure, size);
+        for (int k = 0; k < stride; ++k) {
+            int row, col;
+            storage_position(structure, size, k, row, col);
+            values[k] = generator(row, col);
         }
     }
+}
 
-    return Matrix(size, std::move(values));
+void MatrixGenerator::generate_batch(std::complex<double>* matrices, int count) const {
+    const int stride = storage_size(structure, size);
+    for (int i = 0; i < count; ++i) {
+        generate_into(matrices + i * stride);
+    }
 }
@@ -16,11 +16,19 @@ class MatrixGenerator {
 private:
     int size;
     std::function<std::complex<double>(int, int)> generator;
+    MatrixStructure structure;
 
 public:
-    MatrixGenerator(int size, std::function<std::complex<double>(int, int)> generator);
+    MatrixGenerator(int size, std::function<std::complex<double>(int, int)> generator,
+                    MatrixStructure structure = MatrixStructure::Dense);
 
     Matrix generate() const;
+    // Fill caller-owned storage (storage_size(structure, size) values per matrix)
+    // so batched callers can reuse one buffer instead of allocating per matrix.
+    void generate_into(std::complex<double>* values) const;
+    void generate_batch(std::complex<double>* matrices, int count) const;
+    int get_size() const { return size; }
+    MatrixStructure get_structure() const { return structure; }
 
     // Pre-defined generators
     template<int N>
@@ -39,6 +47,6 @@ public:
             return std::complex<double>(0, 0);
         };
 
-        return MatrixGenerator(N, tridiagonal_generator);
+        return MatrixGenerator(N, tridiagonal_generator, MatrixStructure::Tridiagonal);
     }
 };
\ No newline at end of file
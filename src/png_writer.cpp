@@ -0,0 +1,147 @@
+#include "png_writer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+
+#include "logger.h"
+
+namespace {
+
+constexpr int CHANNELS = 3;
+
+void put_u32(unsigned char* out, uint32_t value) {
+    out[0] = static_cast<unsigned char>(value >> 24);
+    out[1] = static_cast<unsigned char>(value >> 16);
+    out[2] = static_cast<unsigned char>(value >> 8);
+    out[3] = static_cast<unsigned char>(value);
+}
+
+unsigned char paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<unsigned char>(a);
+    return static_cast<unsigned char>(pb <= pc ? b : c);
+}
+
+// Writes the filter type byte and the filtered row to `out`, choosing the
+// filter with the smallest sum of absolute signed residuals, as libpng does.
+void filter_row(const unsigned char* row, const unsigned char* prior, size_t stride,
+                unsigned char* candidate, unsigned char* out) {
+    uint64_t best_cost = UINT64_MAX;
+    for (int type = 0; type < 5; ++type) {
+        uint64_t cost = 0;
+        for (size_t i = 0; i < stride; ++i) {
+            const int a = i >= CHANNELS ? row[i - CHANNELS] : 0;
+            const int b = prior[i];
+            const int c = i >= CHANNELS ? prior[i - CHANNELS] : 0;
+            int predicted = 0;
+            switch (type) {
+                case 1: predicted = a; break;
+                case 2: predicted = b; break;
+                case 3: predicted = (a + b) / 2; break;
+                case 4: predicted = paeth(a, b, c); break;
+            }
+            const unsigned char residual = static_cast<unsigned char>(row[i] - predicted);
+            candidate[i] = residual;
+            cost += std::abs(static_cast<int>(static_cast<signed char>(residual)));
+        }
+        if (cost < best_cost) {
+            best_cost = cost;
+            out[0] = static_cast<unsigned char>(type);
+            std::memcpy(out + 1, candidate, stride);
+        }
+    }
+}
+
+} // namespace
+
+PngWriter::PngWriter(const std::string& filename, int width, int height, int level)
+    : file(filename, std::ios::binary), width(width), height(height), level(level), adler(adler32(0, nullptr, 0)) {
+    if (!file.is_open()) {
+        LOG_ERROR << "Failed to open file for writing: " << filename;
+        return;
+    }
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    unsigned char header[13];
+    put_u32(header, width);
+    put_u32(header + 4, height);
+    header[8] = 8;   // Bit depth
+    header[9] = 2;   // Truecolor
+    header[10] = 0;  // Deflate
+    header[11] = 0;  // Adaptive filtering
+    header[12] = 0;  // No interlacing
+    write_chunk("IHDR", header, sizeof(header));
+}
+
+PngWriter::Strip PngWriter::compress_strip(const unsigned char* previous_row, const unsigned char* rows,
+                                           int count, bool last) const {
+    const size_t stride = static_cast<size_t>(width) * CHANNELS;
+    std::vector<unsigned char> filtered(count * (stride + 1));
+    std::vector<unsigned char> candidate(stride);
+    const std::vector<unsigned char> zeros(previous_row ? 0 : stride, 0);
+    const unsigned char* prior = previous_row ? previous_row : zeros.data();
+    for (int y = 0; y < count; ++y) {
+        const unsigned char* row = rows + y * stride;
+        filter_row(row, prior, stride, candidate.data(), filtered.data() + y * (stride + 1));
+        prior = row;
+    }
+
+    Strip strip;
+    strip.raw_size = filtered.size();
+    strip.adler = adler32(adler32(0, nullptr, 0), filtered.data(), filtered.size());
+
+    z_stream stream = {};
+    deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_FILTERED);
+    strip.data.resize(deflateBound(&stream, filtered.size()) + 16);
+    stream.next_in = filtered.data();
+    stream.avail_in = filtered.size();
+    stream.next_out = strip.data.data();
+    stream.avail_out = strip.data.size();
+    deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    strip.data.resize(stream.total_out);
+    deflateEnd(&stream);
+    return strip;
+}
+
+bool PngWriter::append(const Strip& strip) {
+    if (!started) {
+        // zlib stream header: deflate, 32K window, default compression.
+        static const unsigned char zlib_header[2] = {0x78, 0x9c};
+        write_chunk("IDAT", zlib_header, sizeof(zlib_header));
+        started = true;
+    }
+    adler = adler32_combine(adler, strip.adler, strip.raw_size);
+    write_chunk("IDAT", strip.data.data(), strip.data.size());
+    return file.good();
+}
+
+bool PngWriter::finish() {
+    unsigned char checksum[4];
+    put_u32(checksum, adler);
+    write_chunk("IDAT", checksum, sizeof(checksum));
+    write_chunk("IEND", nullptr, 0);
+    file.close();
+    return !file.fail();
+}
+
+void PngWriter::write_chunk(const char* type, const unsigned char* data, size_t size) {
+    unsigned char length[4];
+    put_u32(length, static_cast<uint32_t>(size));
+    uint32_t crc = crc32(0, reinterpret_cast<const unsigned char*>(type), 4);
+    if (size > 0) {
+        // A null buffer would reset the CRC.
+        crc = crc32(crc, data, size);
+    }
+    unsigned char checksum[4];
+    put_u32(checksum, crc);
+
+    file.write(reinterpret_cast<const char*>(length), 4);
+    file.write(type, 4);
+    if (size > 0) {
+        file.write(reinterpret_cast<const char*>(data), size);
+    }
+    file.write(reinterpret_cast<const char*>(checksum), 4);
+}
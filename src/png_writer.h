@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Streams an 8-bit RGB PNG to disk strip by strip, so no more than a few
+// strips of pixels are ever held in memory.
+//
+// Strips are filtered and deflated independently, each ending on a byte
+// boundary with a sync flush, and their deflate streams simply concatenate
+// (the trick pigz uses). compress_strip() touches no shared state and can run
+// on many threads at once; append() then writes the strips in image order.
+class PngWriter {
+public:
+    struct Strip {
+        std::vector<unsigned char> data;  // Raw deflate blocks
+        uint32_t adler = 1;               // Adler-32 of the filtered rows
+        size_t raw_size = 0;              // Bytes of filtered rows
+    };
+
+    // Writes the signature and header.
+    PngWriter(const std::string& filename, int width, int height, int level = 6);
+
+    bool is_open() const { return file.is_open(); }
+
+    // Filters and deflates `count` rows of packed RGB. `previous_row` is the
+    // row just above them (nullptr for the first strip); PNG filters predict
+    // from it. `last` must be set on the final strip only.
+    Strip compress_strip(const unsigned char* previous_row, const unsigned char* rows, int count, bool last) const;
+    // Appends the next strip in image order.
+    bool append(const Strip& strip);
+    // Writes the checksum and end chunk and closes. Returns false on an I/O error.
+    bool finish();
+
+private:
+    std::ofstream file;
+    int width, height, level;
+    uint32_t adler;
+    bool started = false;
+
+    void write_chunk(const char* type, const unsigned char* data, size_t size);
+};
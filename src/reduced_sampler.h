@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+#include "XoshiroCpp.h"
+
+#include "static_matrix_generator.h"
+#include "util.h"
+
+// Samples the same distribution of spectra as
+// StaticMatrixGenerator<N, TridiagonalPattern, Values>, but in the reduced
+// space the spectrum actually depends on: the diagonal a_k and the products
+// d_k = b_k c_k of opposite off-diagonal entries (see TridiagonalEnumerator).
+//
+// A sample is a list of indices into the distinct diagonal values and the
+// distinct products. Diagonal entries are drawn uniformly from the value set;
+// products are drawn through a table of all (b, c) pairs, so each product
+// comes up with the multiplicity of the pairs giving it. That is one draw per
+// product instead of two, and the indices double as compact keys for
+// SpectrumMemo.
+template<int N, typename Values = BohemianValues>
+class ReducedTridiagonalSampler {
+public:
+    static constexpr int VALUES = static_cast<int>(Values::values.size());
+    static_assert(VALUES * VALUES <= 256, "Indices are stored in bytes");
+
+    struct Sample {
+        std::array<uint8_t, N> diagonal;     // Indices into diagonal_values()
+        std::array<uint8_t, N - 1> product;  // Indices into product_values()
+    };
+
+    explicit ReducedTridiagonalSampler(uint64_t seed = GlobalSeedGenerator::get_next_seed())
+        : rng(seed) {
+        for (int i = 0; i < VALUES; ++i) {
+            diagonal_of[i] = intern(diagonals, Values::values[i]);
+        }
+        for (int b = 0; b < VALUES; ++b) {
+            for (int c = 0; c < VALUES; ++c) {
+                product_of[b * VALUES + c] = intern(products, Values::values[b] * Values::values[c]);
+            }
+        }
+    }
+
+    void draw(Sample& sample) {
+        for (int k = 0; k < N; ++k) {
+            sample.diagonal[k] = diagonal_of[pick(VALUES)];
+        }
+        for (int k = 0; k < N - 1; ++k) {
+            sample.product[k] = product_of[pick(VALUES * VALUES)];
+        }
+    }
+
+    // Band storage (see MatrixStructure) of a matrix with the sample's
+    // spectrum: unit sub-diagonal, products on the super-diagonal.
+    void fill(const Sample& sample, std::complex<double>* values) const {
+        for (int k = 0; k < N; ++k) {
+            values[k] = diagonals[sample.diagonal[k]];
+        }
+        for (int k = 0; k < N - 1; ++k) {
+            values[N + k] = 1;
+            values[2 * N - 1 + k] = products[sample.product[k]];
+        }
+    }
+
+    int get_size() const { return N; }
+    const std::vector<std::complex<double>>& diagonal_values() const { return diagonals; }
+    const std::vector<std::complex<double>>& product_values() const { return products; }
+
+    // RNG state, for checkpointing a run and resuming it exactly.
+    using State = XoshiroCpp::Xoshiro256PlusPlus::state_type;
+    State get_state() const { return rng.serialize(); }
+    void set_state(const State& state) { rng.deserialize(state); }
+
+private:
+    XoshiroCpp::Xoshiro256PlusPlus rng;
+    std::vector<std::complex<double>> diagonals, products;
+    std::array<uint8_t, VALUES> diagonal_of;
+    std::array<uint8_t, VALUES * VALUES> product_of;
+
+    static uint8_t intern(std::vector<std::complex<double>>& distinct, const std::complex<double>& value) {
+        for (size_t i = 0; i < distinct.size(); ++i) {
+            if (distinct[i] == value) {
+                return static_cast<uint8_t>(i);
+            }
+        }
+        distinct.push_back(value);
+        return static_cast<uint8_t>(distinct.size() - 1);
+    }
+
+    // Map a 64-bit draw onto [0, count) with a multiply-shift, as StaticMatrixGenerator does.
+    size_t pick(int count) {
+        return static_cast<size_t>((static_cast<unsigned __int128>(rng()) * count) >> 64);
+    }
+};
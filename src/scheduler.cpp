@@ -0,0 +1,50 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <thread>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "logger.h"
+
+namespace {
+
+int resolve_thread_count(int threads) {
+    if (threads > 0) {
+        return threads;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+} // namespace
+
+Scheduler::Scheduler(int threads)
+    : threads(resolve_thread_count(threads)),
+      arena(this->threads) {
+    LOG_DEBUG << "Scheduler running " << this->threads << " threads";
+}
+
+std::unique_ptr<tbb::global_control> Scheduler::allow_threads(int threads) {
+    // Never below the core count, which would cap every arena instead.
+    const size_t limit = std::max<size_t>(resolve_thread_count(threads), std::thread::hardware_concurrency());
+    return std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, limit);
+}
+
+void Scheduler::run_workers(const std::function<void(int)>& worker) {
+    arena.execute([&] {
+        tbb::parallel_for(0, threads, 1, [&](int index) {
+            worker(index);
+        });
+    });
+}
+
+void Scheduler::parallel_for(uint64_t count, uint64_t grain,
+                             const std::function<void(int, uint64_t, uint64_t)>& body) {
+    arena.execute([&] {
+        tbb::parallel_for(tbb::blocked_range<uint64_t>(0, count, std::max<uint64_t>(grain, 1)),
+                          [&](const tbb::blocked_range<uint64_t>& range) {
+            body(tbb::this_task_arena::current_thread_index(), range.begin(), range.end());
+        });
+    });
+}
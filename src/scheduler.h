@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+
+// Runs parallel work on a TBB task arena with a fixed number of threads.
+//
+// Work is always handed out dynamically, either by the workers themselves
+// (run_workers, pulling from e.g. a BlockDispatcher) or by TBB's work stealing
+// (parallel_for), so slower cores simply end up doing less of it. Every body
+// gets a worker index in [0, thread_count()) for per-thread state such as
+// solvers and local histograms; no two concurrent calls share an index.
+class Scheduler {
+public:
+    // 0 uses every core.
+    explicit Scheduler(int threads = 0);
+
+    // TBB lends all arenas together no more threads than there are cores, and
+    // a global_control limit holds for the whole process, the smallest live
+    // one winning. A program that runs more threads than cores makes one of
+    // these, for its largest thread count, and keeps it alive while its
+    // Schedulers run.
+    static std::unique_ptr<tbb::global_control> allow_threads(int threads);
+
+    int thread_count() const { return threads; }
+
+    // Runs worker(index) once for every index and waits for all of them.
+    void run_workers(const std::function<void(int worker)>& worker);
+    // Covers [0, count) with calls body(worker, begin, end) on chunks of
+    // about `grain` items and waits for all of them.
+    void parallel_for(uint64_t count, uint64_t grain,
+                      const std::function<void(int worker, uint64_t begin, uint64_t end)>& body);
+
+private:
+    int threads;
+    tbb::task_arena arena;
+};
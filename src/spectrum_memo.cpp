@@ -0,0 +1,123 @@
+#include "spectrum_memo.h"
+
+#include <algorithm>
+
+#include "logger.h"
+#include "util.h"
+
+SpectrumMemo::SpectrumMemo(int n, const std::vector<std::complex<double>>& diagonal_values,
+                           const std::vector<std::complex<double>>& product_values, size_t capacity)
+    : n(n), diagonal_values(diagonal_values), product_values(product_values),
+      solvers(n + 1), block_values(3 * n - 2) {
+    for (const auto& product : product_values) {
+        zero_product.push_back(product == 0.0);
+    }
+    const size_t digits = std::max(diagonal_values.size(), product_values.size());
+    digit_bits = 1;
+    while ((size_t(1) << digit_bits) < digits) {
+        digit_bits++;
+    }
+
+    if (capacity > 0) {
+        size_t slots = 1;
+        while (slots < capacity) {
+            slots <<= 1;
+        }
+        mask = slots - 1;
+        keys.assign(slots, 0);
+        spectra.resize(slots * MAX_BLOCK);
+    }
+    for (int rows = 2; rows <= n; ++rows) {
+        solvers[rows] = std::make_unique<EigenSolver>(rows, MatrixStructure::Tridiagonal);
+    }
+}
+
+void SpectrumMemo::use_mixed_precision(double tolerance) {
+    for (auto& solver : solvers) {
+        if (solver) {
+            solver->use_mixed_precision(tolerance);
+        }
+    }
+}
+
+uint64_t SpectrumMemo::double_fallbacks() const {
+    uint64_t fallbacks = 0;
+    for (const auto& solver : solvers) {
+        if (solver) {
+            fallbacks += solver->double_fallbacks();
+        }
+    }
+    return fallbacks;
+}
+
+/// Packs a_0, d_0, a_1, ..., a_{rows-1} below a leading 1 bit, once forwards
+/// and once backwards, and keeps the smaller: both orders share one key.
+uint64_t SpectrumMemo::block_key(const uint8_t* diagonal, const uint8_t* product, int rows, bool& reversed) const {
+    uint64_t forward = 1, backward = 1;
+    for (int k = 0; k < rows; ++k) {
+        forward = (forward << digit_bits) | diagonal[k];
+        backward = (backward << digit_bits) | diagonal[rows - 1 - k];
+        if (k + 1 < rows) {
+            forward = (forward << digit_bits) | product[k];
+            backward = (backward << digit_bits) | product[rows - 2 - k];
+        }
+    }
+    reversed = backward < forward;
+    return reversed ? backward : forward;
+}
+
+bool SpectrumMemo::solve_block(const uint8_t* diagonal, const uint8_t* product, int rows, bool reversed,
+                               std::complex<double>* eigenvalues) {
+    if (rows == 1) {
+        eigenvalues[0] = diagonal_values[diagonal[0]];
+        return true;
+    }
+    // Any matrix with these diagonal entries and off-diagonal products will
+    // do: unit sub-diagonal, products on the super-diagonal.
+    for (int k = 0; k < rows; ++k) {
+        block_values[k] = diagonal_values[diagonal[reversed ? rows - 1 - k : k]];
+    }
+    for (int k = 0; k < rows - 1; ++k) {
+        block_values[rows + k] = 1;
+        block_values[2 * rows - 1 + k] = product_values[product[reversed ? rows - 2 - k : k]];
+    }
+    return solvers[rows]->solve(block_values.data(), eigenvalues);
+}
+
+bool SpectrumMemo::solve(const uint8_t* diagonal, const uint8_t* product, std::complex<double>* eigenvalues) {
+    bool ok = true;
+    for (int begin = 0, end; begin < n; begin = end) {
+        end = begin + 1;
+        while (end < n && !zero_product[product[end - 1]]) {
+            end++;
+        }
+        const int rows = end - begin;
+        const uint8_t* block_diagonal = diagonal + begin;
+        const uint8_t* block_product = product + begin;
+        std::complex<double>* block_eigenvalues = eigenvalues + begin;
+
+        if (rows < 2 || rows > MAX_BLOCK) {
+            ok = solve_block(block_diagonal, block_product, rows, false, block_eigenvalues) && ok;
+            continue;
+        }
+        bool reversed;
+        const uint64_t key = block_key(block_diagonal, block_product, rows, reversed);
+        if (keys.empty()) {
+            ok = solve_block(block_diagonal, block_product, rows, reversed, block_eigenvalues) && ok;
+            continue;
+        }
+        const size_t slot = mix64(key) & mask;
+        std::complex<double>* cached = spectra.data() + slot * MAX_BLOCK;
+        lookup_count++;
+        if (keys[slot] == key) {
+            hit_count++;
+            std::copy(cached, cached + rows, block_eigenvalues);
+        } else if (solve_block(block_diagonal, block_product, rows, reversed, block_eigenvalues)) {
+            keys[slot] = key;
+            std::copy(block_eigenvalues, block_eigenvalues + rows, cached);
+        } else {
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "eigen_solver.h"
+
+// Per-thread eigenvalue cache for tridiagonal matrices in the reduced
+// (diagonal, product) form of ReducedTridiagonalSampler.
+//
+// A zero product splits the matrix into independent diagonal blocks whose
+// spectra together make up the matrix's, and a block's spectrum is unchanged
+// when its index order is reversed. Whole matrices of useful sizes practically
+// never repeat, but short blocks do all the time, so the memo works on
+// blocks: each block of 2 to MAX_BLOCK rows is keyed by the smaller of its
+// forward and reversed index sequences, packed into a 64-bit integer, and its
+// eigenvalues are kept in a direct-mapped table. Single rows need no solve
+// (the eigenvalue is the diagonal entry); longer blocks and misses are solved
+// by an EigenSolver of the block's size, which is also cheaper than solving
+// the whole matrix.
+//
+// Short blocks are always solved in the order of their key, so their
+// eigenvalues are bit for bit the same whether they come from the table or
+// not, and results do not depend on which thread saw a block first.
+class SpectrumMemo {
+public:
+    static constexpr int MAX_BLOCK = 4;
+
+    // `capacity` is rounded up to a power of two; 0 turns caching off.
+    SpectrumMemo(int n, const std::vector<std::complex<double>>& diagonal_values,
+                 const std::vector<std::complex<double>>& product_values, size_t capacity);
+
+    int size() const { return n; }
+    // Forwards to the block solvers, see EigenSolver::use_mixed_precision().
+    void use_mixed_precision(double tolerance);
+
+    // Writes the n eigenvalues of the matrix with diagonal indices
+    // `diagonal[0..n)` and product indices `product[0..n-1)`. Returns false
+    // if LAPACK failed on one of its blocks (whose eigenvalues are then 0).
+    bool solve(const uint8_t* diagonal, const uint8_t* product, std::complex<double>* eigenvalues);
+
+    uint64_t lookups() const { return lookup_count; }
+    uint64_t hits() const { return hit_count; }
+    uint64_t double_fallbacks() const;
+
+private:
+    int n;
+    std::vector<std::complex<double>> diagonal_values, product_values;
+    std::vector<char> zero_product;  // Per product index: splits blocks
+    int digit_bits;
+    size_t mask = 0;
+    std::vector<uint64_t> keys;  // 0 marks an empty slot; keys have a leading 1 bit
+    std::vector<std::complex<double>> spectra;  // MAX_BLOCK per slot
+    std::vector<std::unique_ptr<EigenSolver>> solvers;  // By block size
+    std::vector<std::complex<double>> block_values;
+    uint64_t lookup_count = 0, hit_count = 0;
+
+    // Sets `reversed` if the key is of the reversed order.
+    uint64_t block_key(const uint8_t* diagonal, const uint8_t* product, int rows, bool& reversed) const;
+    bool solve_block(const uint8_t* diagonal, const uint8_t* product, int rows, bool reversed,
+                     std::complex<double>* eigenvalues);
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <array>
+#include <complex>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "XoshiroCpp.h"
+
+#include "matrix.h"
+#include "util.h"
+
+// Value set used by MatrixGenerator::tridiagonal<N>(), as a compile-time table.
+struct BohemianValues {
+    static constexpr std::array<std::complex<double>, 9> values = {{
+        {0, 0}, {1, 0}, {-1, 0}, {0, 1}, {0, -1},
+        {20, 0}, {-20, 0}, {0, 20}, {0, -20}
+    }};
+    static constexpr const char* description = "{0, 1, -1, i, -i, 20, -20, 20i, -20i}";
+};
+
+// Its real members, for matrices that can be solved in real arithmetic.
+struct RealBohemianValues {
+    static constexpr std::array<std::complex<double>, 5> values = {{
+        {0, 0}, {1, 0}, {-1, 0}, {20, 0}, {-20, 0}
+    }};
+    static constexpr const char* description = "{0, 1, -1, 20, -20}";
+};
+
+// Sparsity patterns. A pattern fixes the storage layout (see MatrixStructure)
+// and every stored position is structurally nonzero, so filling a matrix is a
+// single pass over its storage.
+struct TridiagonalPattern {
+    static constexpr MatrixStructure structure = MatrixStructure::Tridiagonal;
+    static constexpr int storage_size(int n) { return 3 * n - 2; }
+};
+
+struct DensePattern {
+    static constexpr MatrixStructure structure = MatrixStructure::Dense;
+    static constexpr int storage_size(int n) { return n * n; }
+};
+
+struct HessenbergPattern {
+    static constexpr MatrixStructure structure = MatrixStructure::UpperHessenberg;
+    static constexpr int storage_size(int n) { return n * (n + 1) / 2 + n - 1; }
+};
+
+// One value per diagonal.
+struct ToeplitzPattern {
+    static constexpr MatrixStructure structure = MatrixStructure::Toeplitz;
+    static constexpr int storage_size(int n) { return 2 * n - 1; }
+};
+
+// The last column, i.e. the negated coefficients of a monic polynomial.
+struct CompanionPattern {
+    static constexpr MatrixStructure structure = MatrixStructure::Companion;
+    static constexpr int storage_size(int n) { return n; }
+};
+
+// The upper triangle. Diagonal entries are drawn from the real values only.
+struct HermitianPattern {
+    static constexpr MatrixStructure structure = MatrixStructure::Hermitian;
+    static constexpr int storage_size(int n) { return n * (n + 1) / 2; }
+};
+
+// The real members of a value table, for entries that must be real.
+template<typename Values>
+constexpr size_t real_value_count() {
+    size_t count = 0;
+    for (const auto& value : Values::values) {
+        count += value.imag() == 0;
+    }
+    return count;
+}
+
+template<typename Values>
+constexpr std::array<double, real_value_count<Values>()> real_values() {
+    std::array<double, real_value_count<Values>()> reals{};
+    size_t k = 0;
+    for (const auto& value : Values::values) {
+        if (value.imag() == 0) {
+            reals[k++] = value.real();
+        }
+    }
+    return reals;
+}
+
+// Fixed-size counterpart of MatrixGenerator. The size, sparsity pattern and
+// value table are template parameters, so generation is an inlined loop over
+// the nonzero positions with no type-erased calls. Each instance owns its RNG;
+// give each worker thread its own generator.
+template<int N, typename Pattern, typename Values = BohemianValues>
+class StaticMatrixGenerator {
+public:
+    static constexpr int stride = Pattern::storage_size(N);
+    using Storage = std::array<std::complex<double>, stride>;
+
+    explicit StaticMatrixGenerator(uint64_t seed = GlobalSeedGenerator::get_next_seed())
+        : rng(seed) {}
+
+    void generate(Storage& storage) {
+        generate_into(storage.data());
+    }
+
+    Matrix generate() {
+        std::vector<std::complex<double>> values(stride);
+        generate_into(values.data());
+        return Matrix(N, std::move(values), Pattern::structure);
+    }
+
+    void generate_into(std::complex<double>* values) {
+        fill(values);
+    }
+
+    void generate_batch(std::complex<double>* matrices, int count) {
+        for (int i = 0; i < count; ++i) {
+            generate_into(matrices + i * stride);
+        }
+    }
+
+    // Real parts only, for real value sets (see EigenSolver::solve_batch()).
+    // Draws the same matrices as the complex overloads.
+    void generate_into(double* values) {
+        fill(values);
+    }
+
+    void generate_batch(double* matrices, int count) {
+        for (int i = 0; i < count; ++i) {
+            generate_into(matrices + i * stride);
+        }
+    }
+
+    int get_size() const { return N; }
+    MatrixStructure get_structure() const { return Pattern::structure; }
+
+    // RNG state, for checkpointing a run and resuming it exactly.
+    using State = XoshiroCpp::Xoshiro256PlusPlus::state_type;
+    State get_state() const { return rng.serialize(); }
+    void set_state(const State& state) { rng.deserialize(state); }
+
+private:
+    XoshiroCpp::Xoshiro256PlusPlus rng;
+
+    // Map a 64-bit draw onto [0, count) with a multiply-shift rather than a modulo.
+    size_t pick(size_t count = Values::values.size()) {
+        return static_cast<size_t>((static_cast<unsigned __int128>(rng()) * count) >> 64);
+    }
+
+    template<typename T>
+    static T entry(const std::complex<double>& value) {
+        if constexpr (std::is_same_v<T, double>) {
+            return value.real();
+        } else {
+            return value;
+        }
+    }
+
+    template<typename T>
+    void fill(T* values) {
+        if constexpr (Pattern::structure == MatrixStructure::Hermitian) {
+            // Only a diagonal entry's real part counts, so drawing it from the
+            // whole table would pile up zeros from the imaginary values.
+            constexpr auto reals = real_values<Values>();
+            static_assert(reals.size() > 0, "Hermitian diagonals need a real value");
+            for (int j = 0, k = 0; j < N; ++j) {
+                for (int i = 0; i < j; ++i) {
+                    values[k++] = entry<T>(Values::values[pick()]);
+                }
+                values[k++] = reals[pick(reals.size())];
+            }
+        } else {
+            for (int k = 0; k < stride; ++k) {
+                values[k] = entry<T>(Values::values[pick()]);
+            }
+        }
+    }
+};
+
+// A StaticMatrixGenerator<N, Pattern, Values> for a pattern and value table
+// chosen at run time, such as a matrix family named in the config; `table`
+// indexes Tables. Dispatch happens once per batch, so filling matrices stays
+// the inlined loop.
+template<int N, typename... Tables>
+class FamilyGenerator {
+public:
+    FamilyGenerator(MatrixStructure structure, int table, uint64_t seed = GlobalSeedGenerator::get_next_seed())
+        : generator(make(structure, table, seed)) {}
+
+    template<typename T>
+    void generate_batch(T* matrices, int count) {
+        std::visit([&](auto& g) { g.generate_batch(matrices, count); }, generator);
+    }
+
+    int get_size() const { return N; }
+    MatrixStructure get_structure() const {
+        return std::visit([](const auto& g) { return g.get_structure(); }, generator);
+    }
+
+    using State = XoshiroCpp::Xoshiro256PlusPlus::state_type;
+    State get_state() const {
+        return std::visit([](const auto& g) { return g.get_state(); }, generator);
+    }
+    void set_state(const State& state) {
+        std::visit([&](auto& g) { g.set_state(state); }, generator);
+    }
+
+private:
+    using Variant = std::variant<StaticMatrixGenerator<N, TridiagonalPattern, Tables>...,
+                                 StaticMatrixGenerator<N, DensePattern, Tables>...,
+                                 StaticMatrixGenerator<N, HessenbergPattern, Tables>...,
+                                 StaticMatrixGenerator<N, ToeplitzPattern, Tables>...,
+                                 StaticMatrixGenerator<N, CompanionPattern, Tables>...,
+                                 StaticMatrixGenerator<N, HermitianPattern, Tables>...>;
+    Variant generator;
+
+    template<typename Pattern>
+    static Variant make(int table, uint64_t seed) {
+        std::optional<Variant> result;
+        int index = 0;
+        ((index++ == table ? void(result.emplace(std::in_place_type<StaticMatrixGenerator<N, Pattern, Tables>>, seed)) : void()), ...);
+        return std::move(*result);
+    }
+
+    static Variant make(MatrixStructure structure, int table, uint64_t seed) {
+        switch (structure) {
+            case MatrixStructure::Tridiagonal:     return make<TridiagonalPattern>(table, seed);
+            case MatrixStructure::UpperHessenberg: return make<HessenbergPattern>(table, seed);
+            case MatrixStructure::Toeplitz:        return make<ToeplitzPattern>(table, seed);
+            case MatrixStructure::Companion:       return make<CompanionPattern>(table, seed);
+            case MatrixStructure::Hermitian:       return make<HermitianPattern>(table, seed);
+            case MatrixStructure::Dense:
+            default:                               return make<DensePattern>(table, seed);
+        }
+    }
+};
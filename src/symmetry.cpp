@@ -0,0 +1,83 @@
+#include "symmetry.h"
+
+#include <algorithm>
+
+namespace {
+
+bool contains(const std::vector<std::complex<double>>& values, const std::complex<double>& z) {
+    return std::find(values.begin(), values.end(), z) != values.end();
+}
+
+bool closed_under(const std::vector<std::complex<double>>& values,
+                  std::complex<double> (*map)(const std::complex<double>&)) {
+    for (const auto& value : values) {
+        if (!contains(values, map(value))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::complex<double> negate(const std::complex<double>& z) { return -z; }
+std::complex<double> conjugate(const std::complex<double>& z) { return std::conj(z); }
+std::complex<double> rotate(const std::complex<double>& z) { return {-z.imag(), z.real()}; }
+
+} // namespace
+
+SymmetryGroup SymmetryGroup::detect(const std::vector<std::complex<double>>& values) {
+    SymmetryGroup group;
+    if (closed_under(values, rotate)) {
+        group.step = 1;
+    } else if (closed_under(values, negate)) {
+        group.step = 2;
+    }
+    // Conjugation fixes every matrix over a real value set: mirroring would
+    // count each spectrum twice and halve the independent samples.
+    const bool real = std::all_of(values.begin(), values.end(),
+                                  [](const std::complex<double>& z) { return z.imag() == 0; });
+    group.conjugation = !real && closed_under(values, conjugate);
+    return group;
+}
+
+SymmetryGroup SymmetryGroup::without_quarter_turns() const {
+    SymmetryGroup group = *this;
+    if (group.step == 1) {
+        group.step = 2;
+    }
+    return group;
+}
+
+SymmetryGroup SymmetryGroup::without_conjugation() const {
+    SymmetryGroup group = *this;
+    group.conjugation = false;
+    return group;
+}
+
+void SymmetryGroup::orbit(const std::complex<double>& z, std::complex<double>* images) const {
+    int k = 0;
+    for (int reflect = 0; reflect <= (conjugation ? 1 : 0); ++reflect) {
+        std::complex<double> w = reflect ? std::conj(z) : z;
+        for (int turns = 0; turns < 4; turns += step) {
+            images[k++] = w;
+            for (int s = 0; s < step; ++s) {
+                w = rotate(w);
+            }
+        }
+    }
+}
+
+std::string SymmetryGroup::describe() const {
+    std::string description;
+    if (step == 1) {
+        description = "rotation by i";
+    } else if (step == 2) {
+        description = "negation";
+    }
+    if (conjugation) {
+        description += description.empty() ? "conjugation" : " + conjugation";
+    }
+    if (description.empty()) {
+        description = "none";
+    }
+    return description + " (order " + std::to_string(order()) + ")";
+}
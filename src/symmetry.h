@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <string>
+
+// Symmetries of a matrix value set that carry over to the spectrum.
+//
+// If the value set is closed under z -> -z, z -> conj(z) or z -> i z, so is the
+// set of matrices built from it, and the eigenvalue distribution picks up the
+// same symmetry: spec(-A) = -spec(A), spec(conj(A)) = conj(spec(A)),
+// spec(iA) = i spec(A). Each sampled matrix then stands for its whole orbit, so
+// we only need 1/order() of the samples and can mirror the counts afterwards.
+//
+// The group is generated by a rotation by rotation_step() quarter turns and,
+// optionally, complex conjugation.
+class SymmetryGroup {
+public:
+    // The trivial group.
+    SymmetryGroup() = default;
+
+    static SymmetryGroup detect(const std::vector<std::complex<double>>& values);
+
+    int order() const { return (4 / step) * (conjugation ? 2 : 1); }
+    bool is_trivial() const { return order() == 1; }
+    // Quarter turns per rotation: 1 for z -> i z, 2 for z -> -z only, 4 for none.
+    int rotation_step() const { return step; }
+    bool has_conjugation() const { return conjugation; }
+
+    // The subgroup that maps the real and imaginary axes onto themselves.
+    SymmetryGroup without_quarter_turns() const;
+    // The rotations alone, for spectra that conjugation maps onto themselves.
+    SymmetryGroup without_conjugation() const;
+
+    // Writes the images of z under every group element (order() values).
+    void orbit(const std::complex<double>& z, std::complex<double>* images) const;
+
+    std::string describe() const;
+
+private:
+    int step = 4;
+    bool conjugation = false;
+};
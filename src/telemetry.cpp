@@ -0,0 +1,185 @@
+#include "telemetry.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+
+#include "logger.h"
+
+namespace {
+
+const char* STAGE_NAMES[] = {"generate", "solve", "bin", "io"};
+const char* COUNTER_NAMES[] = {"samples", "eigenvalues", "solver_failures", "units", "double_fallbacks",
+                               "memo_lookups", "memo_hits"};
+
+std::string format_duration(double seconds) {
+    std::ostringstream out;
+    uint64_t total = static_cast<uint64_t>(seconds + 0.5);
+    if (total >= 3600) out << total / 3600 << "h";
+    if (total >= 60) out << (total / 60) % 60 << "m";
+    out << total % 60 << "s";
+    return out.str();
+}
+
+} // namespace
+
+Telemetry::Telemetry(int threads)
+    : threads(threads),
+      slots(new Slot[threads + 1]),
+      start_time(std::chrono::steady_clock::now()),
+      start_cycles(cycles()) {}
+
+Telemetry::~Telemetry() {
+    stop_reporter();
+}
+
+uint64_t Telemetry::total(Counter counter) const {
+    uint64_t sum = 0;
+    for (int i = 0; i <= threads; ++i) {
+        sum += slots[i].counters[counter].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+uint64_t Telemetry::stage_cycles(Stage stage) const {
+    uint64_t sum = 0;
+    for (int i = 0; i <= threads; ++i) {
+        sum += slots[i].cycles[stage].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+double Telemetry::elapsed_seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+double Telemetry::seconds_per_cycle() const {
+    // Calibrated over the whole run against the steady clock.
+    const uint64_t elapsed_cycles = cycles() - start_cycles;
+    return elapsed_cycles > 0 ? elapsed_seconds() / elapsed_cycles : 0.0;
+}
+
+void Telemetry::start_reporter(Counter counter, uint64_t total, uint64_t done, double interval) {
+    stop_reporter();
+    reporter_stop = false;
+    reporter = std::thread([this, counter, total, done, interval]() {
+        std::unique_lock<std::mutex> lock(reporter_mutex);
+        while (!reporter_wakeup.wait_for(lock, std::chrono::duration<double>(interval), [&] { return reporter_stop; })) {
+            print_status(counter, total, done, false);
+        }
+        print_status(counter, total, done, true);
+    });
+}
+
+void Telemetry::stop_reporter() {
+    if (!reporter.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(reporter_mutex);
+        reporter_stop = true;
+    }
+    reporter_wakeup.notify_all();
+    reporter.join();
+}
+
+void Telemetry::print_status(Counter counter, uint64_t total, uint64_t done, bool final) const {
+    const uint64_t finished = this->total(counter);
+    const double elapsed = elapsed_seconds();
+    const double rate = elapsed > 0 ? finished / elapsed : 0.0;
+    const uint64_t completed = std::min(total, done + finished);
+    const double percent = total > 0 ? 100.0 * completed / total : 100.0;
+
+    double stage_total = 0;
+    double stage_seconds[STAGE_COUNT];
+    const double scale = seconds_per_cycle();
+    for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+        stage_seconds[stage] = stage_cycles(static_cast<Stage>(stage)) * scale;
+        stage_total += stage_seconds[stage];
+    }
+
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "\r[" << std::setw(5) << percent << "%] "
+         << std::setprecision(0) << rate << " " << COUNTER_NAMES[counter] << "/s";
+    if (!final && rate > 0) {
+        line << ", ETA " << format_duration((total - completed) / rate);
+    }
+    if (stage_total > 0) {
+        line << " |";
+        for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+            line << " " << STAGE_NAMES[stage] << " " << std::setprecision(0) << 100.0 * stage_seconds[stage] / stage_total << "%";
+        }
+    }
+    line << "   ";
+    std::cout << line.str() << (final ? "\n" : "") << std::flush;
+}
+
+nlohmann::json Telemetry::report(const nlohmann::json& extra) const {
+    const double elapsed = elapsed_seconds();
+    const double scale = seconds_per_cycle();
+
+    nlohmann::json per_thread = nlohmann::json::array();
+    for (int i = 0; i < threads; ++i) {
+        const uint64_t samples = slots[i].counters[Samples].load(std::memory_order_relaxed);
+        nlohmann::json stages;
+        for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+            stages[STAGE_NAMES[stage]] = slots[i].cycles[stage].load(std::memory_order_relaxed) * scale;
+        }
+        per_thread.push_back({
+            {"samples", samples},
+            {"samples_per_second", elapsed > 0 ? samples / elapsed : 0.0},
+            {"eigenvalues", slots[i].counters[Eigenvalues].load(std::memory_order_relaxed)},
+            {"stage_seconds", stages}
+        });
+    }
+
+    nlohmann::json stages;
+    for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+        stages[STAGE_NAMES[stage]] = stage_cycles(static_cast<Stage>(stage)) * scale;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    const uint64_t samples = total(Samples);
+    const uint64_t eigenvalues = total(Eigenvalues);
+    nlohmann::json result = {
+        {"wall_seconds", elapsed},
+        {"threads", threads},
+        {"samples", samples},
+        {"eigenvalues", eigenvalues},
+        {"samples_per_second", elapsed > 0 ? samples / elapsed : 0.0},
+        {"eigenvalues_per_second", elapsed > 0 ? eigenvalues / elapsed : 0.0},
+        {"units", total(Units)},
+        {"lapack_failures", total(SolverFailures)},
+        {"double_fallbacks", total(DoubleFallbacks)},
+        {"memo_lookups", total(MemoLookups)},
+        {"memo_hit_rate", total(MemoLookups) > 0 ? static_cast<double>(total(MemoHits)) / total(MemoLookups) : 0.0},
+        {"stage_seconds", stages},
+        {"per_thread", per_thread},
+        {"peak_rss_mb", usage.ru_maxrss / 1024.0}
+    };
+    result.update(extra);
+    return result;
+}
+
+bool Telemetry::write_report(const std::string& filename, const nlohmann::json& extra) const {
+    // The default report goes under output/, which a run that renders no
+    // image (a shard, say) never creates.
+    const std::filesystem::path directory = std::filesystem::path(filename).parent_path();
+    std::error_code error;
+    if (!directory.empty()) {
+        std::filesystem::create_directories(directory, error);
+    }
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        LOG_ERROR << "Failed to open file for writing: " << filename;
+        return false;
+    }
+    file << report(extra).dump(2) << std::endl;
+    return file.good();
+}
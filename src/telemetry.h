@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "json.h"
+
+// Run-time counters and stage timers.
+//
+// Every thread owns a cache-line aligned slot that only it writes, so
+// recording is a relaxed load and store with no contention; readers sum the
+// slots. Stage timers count TSC cycles, which are converted to seconds
+// against the steady clock when a report is made. Cheap enough to stay on in
+// release builds: a timer costs two rdtsc per batch of matrices.
+class Telemetry {
+public:
+    enum Counter { Samples, Eigenvalues, SolverFailures, Units, DoubleFallbacks, MemoLookups, MemoHits, COUNTER_COUNT };
+    enum Stage { Generate, Solve, Bin, IO, STAGE_COUNT };
+
+    // `threads` worker slots plus one for the main thread (main_slot()).
+    explicit Telemetry(int threads);
+    ~Telemetry();
+
+    int main_slot() const { return threads; }
+
+    void add(int slot, Counter counter, uint64_t amount) {
+        auto& value = slots[slot].counters[counter];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+    void add_cycles(int slot, Stage stage, uint64_t cycles) {
+        auto& value = slots[slot].cycles[stage];
+        value.store(value.load(std::memory_order_relaxed) + cycles, std::memory_order_relaxed);
+    }
+    uint64_t total(Counter counter) const;
+
+    static uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    // Adds the cycles between construction and destruction to a stage.
+    class Timer {
+    public:
+        Timer(Telemetry& telemetry, int slot, Stage stage)
+            : telemetry(telemetry), slot(slot), stage(stage), start(cycles()) {}
+        ~Timer() { telemetry.add_cycles(slot, stage, cycles() - start); }
+
+    private:
+        Telemetry& telemetry;
+        int slot;
+        Stage stage;
+        uint64_t start;
+    };
+
+    // Prints progress towards `total` units of `counter` every `interval`
+    // seconds on one status line: rate, ETA and where the time goes. `done`
+    // units were finished before this run (e.g. restored from a checkpoint).
+    void start_reporter(Counter counter, uint64_t total, uint64_t done = 0, double interval = 1.0);
+    void stop_reporter();
+
+    // Summary of the run so far: totals, rates per thread, stage breakdown,
+    // LAPACK failures, mixed-precision fallbacks, memo hits and peak resident
+    // memory.
+    // `extra` is merged in.
+    nlohmann::json report(const nlohmann::json& extra = nlohmann::json::object()) const;
+    bool write_report(const std::string& filename, const nlohmann::json& extra = nlohmann::json::object()) const;
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> counters[COUNTER_COUNT] = {};
+        std::atomic<uint64_t> cycles[STAGE_COUNT] = {};
+    };
+
+    int threads;
+    std::unique_ptr<Slot[]> slots;
+    std::chrono::steady_clock::time_point start_time;
+    uint64_t start_cycles;
+
+    std::thread reporter;
+    std::mutex reporter_mutex;
+    std::condition_variable reporter_wakeup;
+    bool reporter_stop = false;
+
+    double seconds_per_cycle() const;
+    double elapsed_seconds() const;
+    uint64_t stage_cycles(Stage stage) const;
+    void print_status(Counter counter, uint64_t total, uint64_t done, bool final) const;
+};
@@ -0,0 +1,71 @@
+#include "tile_store.h"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+TileStore::TileStore(int width, int height, const std::string& spill_file)
+    : tiles_x_((width + TILE_SIZE - 1) >> TILE_BITS),
+      tiles_y_((height + TILE_SIZE - 1) >> TILE_BITS),
+      mapping_size(tile_count() * TILE_AREA * sizeof(uint64_t)),
+      touched_tiles(std::make_unique<std::atomic<uint8_t>[]>(tile_count())) {
+    for (size_t i = 0; i < tile_count(); ++i) {
+        touched_tiles[i].store(0, std::memory_order_relaxed);
+    }
+
+    void* address = MAP_FAILED;
+    if (!spill_file.empty()) {
+        int fd = open(spill_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, mapping_size) != 0) {
+            LOG_ERROR << "Failed to create spill file " << spill_file << "; keeping the histogram in memory";
+        } else {
+            address = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (address == MAP_FAILED) {
+                LOG_ERROR << "Failed to map spill file " << spill_file << "; keeping the histogram in memory";
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+            unlink(spill_file.c_str());
+        }
+        spill = address != MAP_FAILED;
+        if (spill) {
+            LOG_INFO << "Histogram spills to " << spill_file << " (" << (mapping_size >> 20) << " MB)";
+        }
+    }
+    if (address == MAP_FAILED) {
+        // Anonymous pages read as zero and are only backed once written.
+        address = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (address == MAP_FAILED) {
+            LOG_ERROR << "Failed to reserve " << (mapping_size >> 20) << " MB for the histogram";
+            std::abort();
+        }
+    }
+    counters = static_cast<std::atomic<uint64_t>*>(address);
+}
+
+TileStore::~TileStore() {
+    munmap(counters, mapping_size);
+}
+
+void TileStore::clear() {
+    for (size_t tile = 0; tile < tile_count(); ++tile) {
+        if (!touched(tile)) {
+            continue;
+        }
+        for (size_t i = tile * TILE_AREA; i < (tile + 1) * TILE_AREA; ++i) {
+            counters[i].store(0, std::memory_order_relaxed);
+        }
+        touched_tiles[tile].store(0, std::memory_order_relaxed);
+    }
+}
+
+void TileStore::release(size_t first, size_t last) const {
+    // Tiles are 32 KB, so tile ranges are page aligned.
+    if (spill && last > first) {
+        madvise(counters + first * TILE_AREA, (last - first) * TILE_AREA * sizeof(uint64_t), MADV_DONTNEED);
+    }
+}
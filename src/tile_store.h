@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Counter grid of an ImageHistogram, stored as 64 x 64 pixel tiles.
+//
+// The counters live in one virtual mapping that is never initialized, so only
+// the pages of tiles that get touched take memory, and tiles keep 2D
+// neighbourhoods on the same pages. With a spill file the mapping is backed by
+// that (sparse) file instead of anonymous memory: the kernel writes cold tiles
+// back and drops them under memory pressure, so resident memory is bounded by
+// the page cache rather than the image size. The file is unlinked once mapped
+// and disappears with the process.
+class TileStore {
+public:
+    static constexpr int TILE_BITS = 6;
+    static constexpr int TILE_SIZE = 1 << TILE_BITS;
+    static constexpr size_t TILE_AREA = static_cast<size_t>(TILE_SIZE) * TILE_SIZE;
+
+    // An empty `spill_file` keeps the counters in anonymous memory, as does a
+    // spill file that cannot be created.
+    TileStore(int width, int height, const std::string& spill_file = std::string());
+    ~TileStore();
+
+    TileStore(const TileStore&) = delete;
+    TileStore& operator=(const TileStore&) = delete;
+
+    int tiles_x() const { return tiles_x_; }
+    int tiles_y() const { return tiles_y_; }
+    size_t tile_count() const { return static_cast<size_t>(tiles_x_) * tiles_y_; }
+    bool spilled() const { return spill; }
+
+    // Tiles are laid out in row-major tile order, pixels row-major within a tile.
+    size_t index(int x, int y) const {
+        const size_t tile = static_cast<size_t>(y >> TILE_BITS) * tiles_x_ + (x >> TILE_BITS);
+        return (tile << (2 * TILE_BITS)) | ((y & (TILE_SIZE - 1)) << TILE_BITS) | (x & (TILE_SIZE - 1));
+    }
+    static size_t tile_of(size_t index) { return index >> (2 * TILE_BITS); }
+    bool touched(size_t tile) const { return touched_tiles[tile].load(std::memory_order_relaxed) != 0; }
+
+    void add(size_t index, uint64_t count) {
+        touch(tile_of(index));
+        counters[index].fetch_add(count, std::memory_order_relaxed);
+    }
+    // Storing zero into a tile never touched leaves it untouched.
+    void store(size_t index, uint64_t value) {
+        if (value != 0) {
+            touch(tile_of(index));
+        } else if (!touched(tile_of(index))) {
+            return;
+        }
+        counters[index].store(value, std::memory_order_relaxed);
+    }
+    uint64_t load(size_t index) const { return counters[index].load(std::memory_order_relaxed); }
+
+    // Zeroes every touched tile and forgets that it was touched.
+    void clear();
+    // Hints that tiles [first, last) will not be needed for a while. Spilled
+    // tiles leave memory (their counts stay in the file); otherwise a no-op.
+    void release(size_t first, size_t last) const;
+
+private:
+    int tiles_x_, tiles_y_;
+    std::atomic<uint64_t>* counters = nullptr;
+    size_t mapping_size = 0;
+    std::unique_ptr<std::atomic<uint8_t>[]> touched_tiles;
+    bool spill = false;
+
+    void touch(size_t tile) {
+        if (!touched(tile)) {
+            touched_tiles[tile].store(1, std::memory_order_relaxed);
+        }
+    }
+};
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <cstdint>
 #include <mutex>
 
+#include "XoshiroCpp.h"
+
 class GlobalSeedGenerator {
 private:
     std::atomic<uint64_t> seed;
@@ -29,4 +33,70 @@ private:
         std::lock_guard<std::mutex> lock(mutex);
         return seed.fetch_add(1, std::memory_order_seq_cst);
     }
-};
\ No newline at end of file
+};
+// Finalizer of splitmix64: spreads the bits of a packed key over the whole
+// word, so any slice of the result makes a good table index.
+inline uint64_t mix64(uint64_t key) {
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+// Starting state of one of many non-overlapping Xoshiro256++ streams drawn from
+// a single seed. Shard k of a distributed job starts k long jumps (2^192 draws)
+// into the base sequence; BlockDispatcher splits a shard's stream further with
+// jumps (2^128 draws), so no two streams can overlap.
+inline XoshiroCpp::Xoshiro256PlusPlus::state_type stream_state(uint64_t seed, uint64_t shard) {
+    XoshiroCpp::Xoshiro256PlusPlus rng(seed);
+    for (uint64_t i = 0; i < shard; ++i) {
+        rng.longJump();
+    }
+    return rng.serialize();
+}
+
+// Splits a sampling run into fixed-size blocks handed out in order. Block b
+// draws from the stream b jumps past the first, whichever thread takes it, so
+// the samples (and any histogram summed from them) do not depend on the
+// number of threads.
+class BlockDispatcher {
+public:
+    using State = XoshiroCpp::Xoshiro256PlusPlus::state_type;
+
+    struct Block {
+        uint64_t begin, end;  // Sample range
+        State rng;            // Stream to draw the block's matrices from
+    };
+
+    BlockDispatcher(uint64_t samples, uint64_t block_size, const State& first_stream)
+        : samples(samples), block_size(block_size), stream(first_stream) {}
+
+    // Takes the next block; false once all samples are handed out.
+    bool next(Block& block) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (position >= samples) {
+            return false;
+        }
+        block.begin = position;
+        block.end = std::min(position + block_size, samples);
+        block.rng = stream.serialize();
+        position = block.end;
+        stream.jump();
+        return true;
+    }
+
+    // Where the next block starts, for checkpoints. Only consistent while no
+    // handed-out block is still being worked on.
+    uint64_t handed_out() const { return position; }
+    State next_stream() const { return stream.serialize(); }
+    void restore(uint64_t handed_out, const State& next_stream) {
+        position = handed_out;
+        stream.deserialize(next_stream);
+    }
+
+private:
+    std::mutex mutex;
+    uint64_t samples;
+    uint64_t block_size;
+    uint64_t position = 0;
+    XoshiroCpp::Xoshiro256PlusPlus stream;
+};
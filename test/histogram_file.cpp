@@ -0,0 +1,188 @@
+// Checks the histogram file format (histogram_file.h) that dump, load, merge
+// and render persist through: an image histogram written and read back keeps
+// every bin and the header, metadata included, merge_histogram_files() of two
+// files is their bin-wise sum, and a writer that never finishes leaves the
+// previous file in place. Exits non-zero if any check fails.
+//
+// Usage: bohemia_histogram_test
+
+#include <complex>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "XoshiroCpp.h"
+
+#include "histogram_file.h"
+#include "image.h"
+
+namespace {
+
+using Bins = std::map<std::pair<int64_t, int64_t>, uint64_t>;
+
+constexpr int RESOLUTION = 300;
+constexpr double REAL_MIN = -3, REAL_MAX = 2, IMAG_MIN = -1, IMAG_MAX = 2;
+
+int failures = 0;
+
+void check(const char* name, bool passed) {
+    std::printf("%s %s\n", passed ? "PASS" : "FAIL", name);
+    failures += !passed;
+}
+
+std::string scratch_file(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / ("bohemia_histogram_test_" + name)).string();
+}
+
+std::vector<std::complex<double>> random_points(size_t count, XoshiroCpp::Xoshiro256PlusPlus& rng) {
+    std::vector<std::complex<double>> points(count);
+    for (auto& point : points) {
+        // Spill past the viewport on every side, so clipping is covered too.
+        point = {-4 + 7 * XoshiroCpp::DoubleFromBits(rng()), -2 + 5 * XoshiroCpp::DoubleFromBits(rng())};
+    }
+    return points;
+}
+
+// The bins ImageHistogram should hold for `points`, computed independently.
+Bins expected_bins(const std::vector<std::complex<double>>& points, int width, int height) {
+    Bins bins;
+    for (const auto& point : points) {
+        if (point.real() < REAL_MIN || point.real() > REAL_MAX || point.imag() < IMAG_MIN || point.imag() > IMAG_MAX) {
+            continue;
+        }
+        const int x = static_cast<int>((point.real() - REAL_MIN) / (REAL_MAX - REAL_MIN) * width);
+        const int y = static_cast<int>((point.imag() - IMAG_MIN) / (IMAG_MAX - IMAG_MIN) * height);
+        if (x >= 0 && x < width && y >= 0 && y < height) {
+            bins[{y, x}]++;
+        }
+    }
+    return bins;
+}
+
+bool read_bins(const std::string& filename, HistogramHeader& header, Bins& bins) {
+    HistogramReader reader(filename);
+    if (!reader.is_open()) {
+        return false;
+    }
+    header = reader.header();
+    int64_t row, column;
+    uint64_t count;
+    while (reader.next(row, column, count)) {
+        bins[{row, column}] += count;
+    }
+    return reader.is_open() && bins.size() == header.entries;
+}
+
+bool write_points(const std::string& filename, const std::vector<std::complex<double>>& points,
+                  const std::string& metadata, int& width, int& height) {
+    ImageHistogram histogram(RESOLUTION, REAL_MIN, REAL_MAX, IMAG_MIN, IMAG_MAX);
+    for (const auto& point : points) {
+        histogram.add_point(point);
+    }
+    width = histogram.get_width();
+    height = histogram.get_height();
+    return histogram.write_to_file(filename, points.size(), "test generator", metadata);
+}
+
+void check_round_trip(XoshiroCpp::Xoshiro256PlusPlus& rng) {
+    const auto points = random_points(200000, rng);
+    const std::string file = scratch_file("round_trip.bin"), reloaded_file = scratch_file("reloaded.bin");
+    // Bytes a text format would choke on.
+    const std::string metadata = std::string("{\"first_unit\":0}\0\xff\n", 19);
+    int width, height;
+    HistogramHeader header;
+    Bins bins;
+    const bool written = write_points(file, points, metadata, width, height) && read_bins(file, header, bins);
+    check("image histogram is written and read back", written);
+    if (!written) {
+        return;
+    }
+    check("every bin survives bin for bin", bins == expected_bins(points, width, height));
+    check("header keeps the viewport", header.kind == HistogramHeader::Kind::Image &&
+          header.resolution == RESOLUTION && header.width == width && header.height == height &&
+          header.real_min == REAL_MIN && header.real_max == REAL_MAX &&
+          header.imag_min == IMAG_MIN && header.imag_max == IMAG_MAX);
+    check("header keeps samples and generator", header.samples == points.size() && header.generator == "test generator");
+    check("header keeps the v2 metadata block", header.metadata == metadata);
+
+    // Loading into a histogram over the same grid and writing again changes nothing.
+    ImageHistogram reloaded(RESOLUTION, REAL_MIN, REAL_MAX, IMAG_MIN, IMAG_MAX);
+    HistogramHeader reloaded_header;
+    Bins reloaded_bins;
+    check("load_from_file then write_to_file is lossless",
+          reloaded.load_from_file(file) &&
+          reloaded.write_to_file(reloaded_file, header.samples, header.generator, header.metadata) &&
+          read_bins(reloaded_file, reloaded_header, reloaded_bins) && reloaded_bins == bins &&
+          reloaded_header.metadata == metadata);
+    std::filesystem::remove(file);
+    std::filesystem::remove(reloaded_file);
+}
+
+void check_merge(XoshiroCpp::Xoshiro256PlusPlus& rng) {
+    const auto first_points = random_points(100000, rng), second_points = random_points(150000, rng);
+    const std::string first = scratch_file("first.bin"), second = scratch_file("second.bin"), merged = scratch_file("merged.bin");
+    int width, height;
+    HistogramHeader first_header, second_header, merged_header;
+    Bins first_bins, second_bins, merged_bins;
+    const bool written = write_points(first, first_points, "first", width, height) &&
+                         write_points(second, second_points, "second", width, height) &&
+                         read_bins(first, first_header, first_bins) && read_bins(second, second_header, second_bins);
+    check("two histograms are written", written);
+    if (!written) {
+        return;
+    }
+    const bool merged_ok = merge_histogram_files({first, second}, merged) && read_bins(merged, merged_header, merged_bins);
+    check("merge_histogram_files succeeds", merged_ok);
+    if (merged_ok) {
+        Bins sum = first_bins;
+        for (const auto& [bin, count] : second_bins) {
+            sum[bin] += count;
+        }
+        check("merged bins are the bin-wise sum", merged_bins == sum);
+        check("merged samples are the sum", merged_header.samples == first_points.size() + second_points.size());
+        check("merged header stays compatible", merged_header.compatible_with(first_header));
+    }
+    std::filesystem::remove(first);
+    std::filesystem::remove(second);
+    std::filesystem::remove(merged);
+}
+
+void check_unfinished_write(XoshiroCpp::Xoshiro256PlusPlus& rng) {
+    const auto points = random_points(50000, rng);
+    const std::string file = scratch_file("unfinished.bin");
+    int width, height;
+    HistogramHeader header;
+    Bins bins;
+    check("finished write leaves no temporary file",
+          write_points(file, points, "complete", width, height) && !std::filesystem::exists(file + ".tmp"));
+
+    {
+        // Stands for a run that dies, or fails, halfway through its dump.
+        HistogramHeader partial;
+        partial.generator = "partial";
+        HistogramWriter writer(file, partial);
+        writer.append(0, 0, 1);
+    }
+    check("unfinished write keeps the previous file",
+          read_bins(file, header, bins) && header.metadata == "complete" &&
+          bins == expected_bins(points, width, height) && !std::filesystem::exists(file + ".tmp"));
+    std::filesystem::remove(file);
+}
+
+} // namespace
+
+int main() {
+    XoshiroCpp::Xoshiro256PlusPlus rng(7);
+    check_round_trip(rng);
+    check_merge(rng);
+    check_unfinished_write(rng);
+    if (failures > 0) {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Checks that a seeded sampling run dumps the same histogram and renders the
+# same PNG, byte for byte, on 1 and on 4 threads, with tiled and with PMF
+# binning. Exits non-zero on any difference.
+#
+# Usage: test/reproducible_test.sh <path to bohemia>
+
+set -u
+bohemia=$(realpath "$1")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work" || exit 1
+
+# Runs the seeded config with binning $1 on $2 threads into run-$1-$2.
+run() {
+    cat > "run-$1-$2.json" <<EOF
+{
+    "resolution": 400,
+    "samples": 150000,
+    "seed": 13,
+    "threads": $2,
+    "binning": "$1",
+    "precision": 3,
+    "ignore_reals": false,
+    "eigenvalues": {"mode": "dump", "file": "run-$1-$2.bin"},
+    "visualization_params": {
+        "real_min": -50, "real_max": 50, "imaginary_min": -50, "imaginary_max": 50,
+        "output_file": "run-$1-$2.png", "gamma": 2.2, "color_map": "viridis"
+    }
+}
+EOF
+    "$bohemia" "run-$1-$2.json" > "run-$1-$2.log" 2>&1
+}
+
+status=0
+for binning in tiled pmf; do
+    if ! run $binning 1 || ! run $binning 4; then
+        echo "FAIL $binning run"
+        status=1
+        continue
+    fi
+    for output in run-$binning-%s.bin output/run-$binning-%s.png; do
+        one=$(printf "$output" 1)
+        four=$(printf "$output" 4)
+        if cmp -s "$one" "$four"; then
+            echo "PASS $one matches on 1 and 4 threads"
+        else
+            echo "FAIL $one differs between 1 and 4 threads"
+            status=1
+        fi
+    done
+done
+exit $status
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Checks that --shard runs started in an empty directory each write their
+# dump and their run report (under output/, which no shard renders into),
+# and that `bohemia merge` sums the dumps into one covering every sample.
+# Exits non-zero on any failure.
+#
+# Usage: test/shard_test.sh <path to bohemia>
+
+set -u
+bohemia=$(realpath "$1")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work" || exit 1
+
+cat > shard.json <<CONFIG
+{
+    "resolution": 200,
+    "samples": 40000,
+    "seed": 5,
+    "threads": 2,
+    "precision": 3,
+    "ignore_reals": false,
+    "eigenvalues": {"mode": "dump", "file": "shard.bin"},
+    "visualization_params": {
+        "real_min": -50, "real_max": 50, "imaginary_min": -50, "imaginary_max": 50,
+        "output_file": "shard.png", "gamma": 2.2, "color_map": "viridis"
+    }
+}
+CONFIG
+
+status=0
+for shard in 0 1; do
+    if ! "$bohemia" shard.json --shard $shard/2 > "log.$shard" 2>&1; then
+        echo "FAIL shard $shard/2 run"
+        status=1
+        continue
+    fi
+    for file in shard.bin.$shard-of-2 output/shard.report.$shard-of-2.json; do
+        if [ -s "$file" ]; then
+            echo "PASS shard $shard/2 wrote $file"
+        else
+            echo "FAIL shard $shard/2 did not write $file"
+            status=1
+        fi
+    done
+done
+[ $status -eq 0 ] || exit $status
+
+if "$bohemia" merge shard.json shard.bin.0-of-2 shard.bin.1-of-2 > log.merge 2>&1 &&
+   grep -q "standing for 40000 samples" log.merge && [ -s shard.bin ]; then
+    echo "PASS merged shards cover all 40000 samples"
+else
+    echo "FAIL merging the shards"
+    status=1
+fi
+exit $status
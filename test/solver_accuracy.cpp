@@ -0,0 +1,135 @@
+// Checks the fast solver paths against zgeev on the dense expansion of the
+// same matrices: the Aberth engine, mixed precision and real arithmetic, on
+// Bohemian batches drawn from a fixed seed. Exits non-zero if any path is
+// further than its tolerance from the reference.
+//
+// Usage: bohemia_test
+
+#include <algorithm>
+#include <complex>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+#include "XoshiroCpp.h"
+
+#include "eigen_solver.h"
+#include "matrix.h"
+#include "static_matrix_generator.h"
+
+namespace {
+
+constexpr int BATCH = EigenSolver::DEFAULT_BATCH_SIZE;
+// Bohemian spectra have multiple eigenvalues, which no solver gets to more
+// than about the square root of machine precision; a wrong or unconverged
+// root is off by far more than this.
+constexpr double TOLERANCE = 1e-3;
+
+template<typename Values>
+std::vector<std::complex<double>> bohemian_batch(int n, MatrixStructure structure, XoshiroCpp::Xoshiro256PlusPlus& rng) {
+    std::vector<std::complex<double>> values(BATCH * storage_size(structure, n));
+    for (auto& value : values) {
+        value = Values::values[rng() % Values::values.size()];
+    }
+    return values;
+}
+
+// zgeev on the dense expansion of every matrix in the batch.
+std::vector<std::complex<double>> reference_eigenvalues(int n, MatrixStructure structure,
+                                                        const std::vector<std::complex<double>>& matrices) {
+    const int stride = storage_size(structure, n);
+    EigenSolver dense(n, MatrixStructure::Dense);
+    std::vector<std::complex<double>> dense_matrix(n * n), eigenvalues(BATCH * n);
+    for (int i = 0; i < BATCH; ++i) {
+        const Matrix matrix(n, std::vector<std::complex<double>>(matrices.begin() + i * stride,
+                                                                 matrices.begin() + (i + 1) * stride),
+                            structure);
+        for (int row = 0; row < n; ++row) {
+            for (int column = 0; column < n; ++column) {
+                dense_matrix[row * n + column] = matrix.get(row, column);
+            }
+        }
+        dense.solve(dense_matrix.data(), eigenvalues.data() + i * n);
+    }
+    return eigenvalues;
+}
+
+// Largest distance from an eigenvalue to the nearest reference one; the paths
+// may order them differently.
+double max_error(int n, const std::vector<std::complex<double>>& candidate,
+                 const std::vector<std::complex<double>>& reference) {
+    double error = 0;
+    for (int i = 0; i < BATCH; ++i) {
+        for (int k = 0; k < n; ++k) {
+            double nearest = std::numeric_limits<double>::max();
+            for (int j = 0; j < n; ++j) {
+                nearest = std::min(nearest, std::abs(candidate[i * n + k] - reference[i * n + j]));
+            }
+            error = std::max(error, nearest);
+        }
+    }
+    return error;
+}
+
+int failures = 0;
+
+void check(const char* path, int n, MatrixStructure structure, double error, double tolerance) {
+    const bool passed = error <= tolerance;
+    std::printf("%s %-6s n=%-3d %-11s max error %.3g (tolerance %.3g)\n", passed ? "PASS" : "FAIL",
+                path, n, structure_name(structure), error, tolerance);
+    failures += !passed;
+}
+
+void check_aberth(int n, MatrixStructure structure, XoshiroCpp::Xoshiro256PlusPlus& rng) {
+    auto matrices = bohemian_batch<BohemianValues>(n, structure, rng);
+    const auto reference = reference_eigenvalues(n, structure, matrices);
+    EigenSolver solver(n, structure);
+    solver.use_aberth();
+    std::vector<std::complex<double>> eigenvalues(BATCH * n);
+    solver.solve_batch(matrices.data(), BATCH, eigenvalues.data());
+    check("aberth", n, structure, max_error(n, eigenvalues, reference), TOLERANCE);
+}
+
+// The mixed path promises its own tolerance.
+void check_mixed(int n, MatrixStructure structure, XoshiroCpp::Xoshiro256PlusPlus& rng) {
+    auto matrices = bohemian_batch<BohemianValues>(n, structure, rng);
+    const auto reference = reference_eigenvalues(n, structure, matrices);
+    EigenSolver solver(n, structure);
+    solver.use_mixed_precision(TOLERANCE);
+    std::vector<std::complex<double>> eigenvalues(BATCH * n);
+    solver.solve_batch(matrices.data(), BATCH, eigenvalues.data());
+    check("mixed", n, structure, max_error(n, eigenvalues, reference), TOLERANCE);
+}
+
+void check_real(int n, MatrixStructure structure, XoshiroCpp::Xoshiro256PlusPlus& rng) {
+    const auto matrices = bohemian_batch<RealBohemianValues>(n, structure, rng);
+    const auto reference = reference_eigenvalues(n, structure, matrices);
+    std::vector<double> real_matrices(matrices.size());
+    std::transform(matrices.begin(), matrices.end(), real_matrices.begin(),
+                   [](const std::complex<double>& value) { return value.real(); });
+    EigenSolver solver(n, structure);
+    std::vector<std::complex<double>> eigenvalues(BATCH * n);
+    solver.solve_batch(real_matrices.data(), BATCH, eigenvalues.data());
+    check("real", n, structure, max_error(n, eigenvalues, reference), TOLERANCE);
+}
+
+} // namespace
+
+int main() {
+    XoshiroCpp::Xoshiro256PlusPlus rng(20);
+    for (int n : {10, 32}) {
+        for (auto structure : {MatrixStructure::Tridiagonal, MatrixStructure::Companion}) {
+            check_aberth(n, structure, rng);
+            check_real(n, structure, rng);
+        }
+        for (auto structure : {MatrixStructure::Tridiagonal, MatrixStructure::Dense}) {
+            check_mixed(n, structure, rng);
+        }
+    }
+    if (failures > 0) {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}